@@ -0,0 +1,38 @@
+#ifndef ASSETS_H
+#define ASSETS_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// One file baked into the executable by asset_embed, see the generated assets.cpp.
+// path is relative to the repo root, data has a 0 byte after the last one.
+struct EmbeddedAsset {
+    const char* path;
+    const unsigned char* data;
+    size_t size;
+};
+
+// sorted by path
+extern const EmbeddedAsset embedded_assets[];
+extern const size_t embedded_asset_count;
+
+// Bytes of one asset. Embedded assets point straight into the executable, loose files
+// are read into storage.
+struct Asset {
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+    std::vector<unsigned char> storage;
+
+    std::string_view text() const { return std::string_view((const char*)data, size); }
+};
+
+// Finds path (e.g. "src/shaders/fShader2.glsl", "maps/map1/map.json") in the embedded
+// pack, falling back to the loose file relative to the working directory. Builds with
+// LOOSE_ASSETS check the loose file first, so shaders and maps can be edited without
+// rebuilding.
+bool loadAsset(const std::string& path, Asset& asset);
+bool assetExists(const std::string& path);
+
+#endif
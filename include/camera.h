@@ -0,0 +1,39 @@
+#ifndef CAMERA_H
+#define CAMERA_H
+
+#include "glad/glad.h"
+#include "glm/glm.hpp"
+
+// Per frame view state, laid out to match the std140 Camera block the shaders declare
+// at uniform binding 0. Filled in once per frame and shared by every program.
+struct CameraUniforms {
+    glm::vec4 pos_dir;      // player position xy, view direction zw
+    glm::vec4 plane;        // camera plane xy, eye level, wall height
+    glm::vec4 screen;       // framebuffer width, height, projection scale, time
+    glm::vec4 fog;          // fog colour rgb, density per world unit past the fog start
+    glm::vec4 view;         // view distance, fog start, lod distance, unused
+};
+
+class CameraBuffer {
+public:
+    unsigned int ID = 0;
+
+    void create() {
+        glGenBuffers(1, &ID);
+        glBindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraUniforms), NULL, GL_DYNAMIC_DRAW);
+        glBindBufferBase(GL_UNIFORM_BUFFER, 0, ID);
+    }
+
+    void update(const CameraUniforms &camera) const {
+        glBindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(CameraUniforms), &camera);
+    }
+
+    void del() {
+        glDeleteBuffers(1, &ID);
+        ID = 0;
+    }
+};
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef COLUMN_HIZ_H
+#define COLUMN_HIZ_H
+
+#include <vector>
+
+// Min/max pyramid over the per column wall depth of the last frame (1D Hi-Z).
+// Rebuilt from the ray loop's column depths in O(columns), after which a range of
+// columns answers "nearest/farthest wall" or "is something at depth d hidden behind
+// walls all the way across" in O(log columns), without looking at every column.
+// Depth is distance along the view direction, the same as the sprite column buffer.
+class ColumnHiZ {
+public:
+    void build(const std::vector<float>& depth);
+    int columns() const { return count; }
+
+    // Farthest and nearest wall over columns first..last (inclusive, clamped to the screen)
+    float maxDepth(int first, int last) const;
+    float minDepth(int first, int last) const;
+    // True when every column from first to last has a wall closer than depth
+    bool occluded(int first, int last, float depth) const { return maxDepth(first, last) <= depth; }
+    // Columns covered by the screen space interval [x_min, x_max] (camera_x, -1 to 1)
+    void columnRange(float x_min, float x_max, int& first, int& last) const;
+
+private:
+    // implicit binary trees, leaves from size onwards, node i covers 2i and 2i+1
+    std::vector<float> max_tree;
+    std::vector<float> min_tree;
+    int size = 0;
+    int count = 0;
+};
+
+#endif
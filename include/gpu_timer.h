@@ -0,0 +1,41 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include "glad/glad.h"
+
+// GL_TIME_ELAPSED around one pass. Two queries take turns so the result read back is
+// always the previous frame's, which is done by then and doesn't stall the pipeline.
+class GpuTimer {
+public:
+    unsigned int queries[2] = {0, 0};
+    int current = 0;
+    bool pending[2] = {false, false};
+    double last_ms = 0.0;
+
+    void create() {
+        glGenQueries(2, queries);
+    }
+
+    void begin() {
+        glBeginQuery(GL_TIME_ELAPSED, queries[current]);
+    }
+
+    void end() {
+        glEndQuery(GL_TIME_ELAPSED);
+        pending[current] = true;
+        current ^= 1;
+        if (pending[current]) {
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(queries[current], GL_QUERY_RESULT, &ns);
+            last_ms = ns / 1.0e6;
+            pending[current] = false;
+        }
+    }
+
+    void del() {
+        glDeleteQueries(2, queries);
+        queries[0] = queries[1] = 0;
+    }
+};
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef LIGHT_GRID_H
+#define LIGHT_GRID_H
+
+#include "map.h"
+#include "map_edits.h"
+#include "raycast.h"
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <utility>
+#include <vector>
+
+// Most a dynamic light can be, it reaches max_light_level-1 cells out
+const int max_light_level = 15;
+
+// Where LightGrid::update spent its time, summed since the counters were last reset
+struct LightTiming {
+    int updates = 0;
+    long cells = 0;             // cells taken off the queues
+    double ms = 0.0;
+};
+
+// Light levels for the moving lights (torches, muzzle flashes), one 0-max_light_level
+// value per cell of map.grid, flood filled out from each light through the open cells
+// and one level darker per cell. Where lights overlap a cell keeps the brightest.
+// Nothing is ever refilled from scratch: adding a light, or an open cell, floods out
+// from there; taking one away first clears the cells that got their light through it
+// and then refills them from whatever still reaches their edge. Lights only change
+// the grid when they move into another cell, so lights walking about cost a few
+// hundred cells each time they cross a cell edge and nothing in between.
+//
+// Walls, moving blocks included, stop the light; shaped and see-through cells let it
+// through. Register it with the MapEditor to have edits relight around them, and hand
+// the cells moving blocks take and let go of to MapEditor::notify for the same.
+class LightGrid : public MapListener {
+public:
+    // Sizes the grid for map and drops every light
+    void reset(const Map& map);
+
+    // Returns the light's id, level is clamped to 0-max_light_level
+    int addLight(glm::vec2 pos, int level);
+    void moveLight(int id, glm::vec2 pos);
+    void setLevel(int id, int level);
+    void removeLight(int id);
+    int lightCount() const { return sources.size() - free_ids.size(); }
+
+    // Works through what the changes since the last update left queued, at most budget
+    // cells of it; the rest waits for the next call. Clearing always finishes before
+    // anything is refilled, a cut short update leaves too little light, never stale
+    // light. Returns the cells done.
+    int update(const Map& map, int budget=1 << 30);
+    bool pending() const { return !dark_queue.empty() || !light_queue.empty(); }
+
+    // 0-1, 0 outside the map
+    float level(int x, int y) const;
+    // Light falling on the face hit shows, colour times the level of the open cell in
+    // front of it, blended across the face with the cells either side like the lightmap
+    glm::vec3 faceLight(const Map& map, const RayHit& hit) const;
+
+    void cellsChanged(const Map& map, const std::vector<CellEdit>& edits) override;
+
+    glm::vec3 colour = glm::vec3(1.0f, 0.8f, 0.55f);
+    LightTiming timing;
+
+private:
+    struct Source {
+        int cell = -1;          // -1 outside the map
+        int level = 0;
+        bool used = false;
+    };
+
+    bool opaque(const Map& map, int cell) const;
+    void place(int cell, int level);
+    void take(int cell);
+    int sourceLevel(int cell) const;
+
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> levels;
+    std::vector<uint8_t> source_levels;     // brightest light standing in each cell
+    std::vector<Source> sources;
+    std::vector<int> free_ids;
+    std::deque<std::pair<int, uint8_t>> dark_queue;     // cleared cell and the level it had
+    std::deque<int> light_queue;                        // cells to flood out from
+};
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef LIGHTMAP_H
+#define LIGHTMAP_H
+
+#include "glm/glm.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Light baked by light_baker for every wall face that can be seen: samples RGB values
+// spread evenly across the face, from its low x (or y) end to the high one. Stored as
+// 0-255 for 0-2 so lights can brighten a texture as well as darken it.
+struct Lightmap {
+    int samples = 0;
+    std::vector<int32_t> face_slot;     // per cell*4 + side, -1 for faces that weren't baked
+    std::vector<uint8_t> rgb;           // samples*3 per slot
+
+    bool empty() const { return face_slot.empty(); }
+
+    // u is the 0-1 position across the face (RayHit::face_u). Walls are unlit without a
+    // lightmap, faces it has nothing for get fallback.
+    glm::vec3 sample(int cell, int side, float u, glm::vec3 fallback) const {
+        if (face_slot.empty()) return glm::vec3(1.0f);
+        int slot = cell >= 0 ? face_slot[cell*4 + side] : -1;
+        if (slot < 0) return fallback;
+        float x = std::clamp(u*samples - 0.5f, 0.0f, samples - 1.0f);
+        int i = (int)x;
+        int j = std::min(i+1, samples-1);
+        const uint8_t* a = &rgb[(slot*samples + i)*3];
+        const uint8_t* b = &rgb[(slot*samples + j)*3];
+        glm::vec3 mixed = glm::mix(glm::vec3(a[0], a[1], a[2]), glm::vec3(b[0], b[1], b[2]), x - i);
+        return mixed * (2.0f/255.0f);
+    }
+};
+
+// "RCLM" file: version, map width and height, samples and slot count as int32, then per
+// slot its cell and side (int32 each) followed by samples*3 bytes of light
+bool saveLightmap(const std::string& path, int width, int height, const Lightmap& lightmap);
+// Fails (leaving lightmap empty) if the file is missing, broken or for another map size
+bool loadLightmap(const std::string& path, int width, int height, Lightmap& lightmap);
+
+#endif
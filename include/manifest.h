@@ -0,0 +1,162 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include "glm/glm.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct Entity {
+    int type = 0;
+    glm::vec2 pos = glm::vec2(0.0f);
+    float ang = 0.0f;
+    int texture = 0;        // drawn as a sprite with this texture index
+    float size = 1.0f;      // sprite width and height in world units
+};
+
+// A wall block that slides back and forth between its cell and the one cells away
+// along (dx, dy) for as long as the map is loaded
+struct Mover {
+    int x = 0;
+    int y = 0;
+    int dx = 1;
+    int dy = 0;
+    int cells = 1;
+    float speed = 1.0f;     // cells per second
+};
+
+// A wall face that rays and the player go into and come out of another face, anywhere
+// in the map and facing any way. Sides are "west", "south", "east" or "north".
+struct Portal {
+    int x = 0;
+    int y = 0;
+    int side = 0;           // RayHit side order: 0 west, 1 south, 2 east, 3 north
+    int to_x = 0;
+    int to_y = 0;
+    int to_side = 0;
+    bool two_way = true;    // the exit face leads back into the entry one
+};
+
+// A view for monitor materials to show, see security_cameras.h
+struct SecurityCamera {
+    glm::vec2 pos = glm::vec2(0.0f);
+    float ang = 0.0f;       // radians, the file stores degrees
+    float fov = 1.0472f;    // same, 60 degrees by default
+};
+
+// A light for light_baker. size 0 is a point, anything bigger a square area light that
+// many cells across, which gives soft shadow edges.
+struct Light {
+    glm::vec2 pos = glm::vec2(0.0f);
+    glm::vec3 colour = glm::vec3(1.0f);
+    float intensity = 1.0f;
+    float radius = 8.0f;    // cells until it has faded out
+    float size = 0.0f;
+};
+
+// Where a texture sits in the atlas, in pixels of its page
+struct AtlasRect {
+    int page = 0;
+    int x = 0;
+    int y = 0;
+    int w = 0;
+    int h = 0;
+};
+
+// Contents of maps/<name>/map.json. The defaults are what every map used before
+// manifests existed, so a map folder without one still loads the same way.
+struct MapManifest {
+    glm::vec2 spawn_pos = glm::vec2(2.5f, 3.45f);
+    float spawn_ang = 0.0f;                         // radians, the file stores degrees
+    float wall_height = 4.0f;
+    std::string walls = "walls.png";
+    // more walls pngs stacked on top of walls, each one wall_height above the last
+    std::vector<std::string> layers;
+    // "rgb": the original r/4 + g/16 + b/64 editor encoding, 21 materials at most
+    // "material16": material = r*256 + g, rotation = b/64
+    std::string grid_encoding = "rgb";
+    // per cell floor and ceiling materials, pngs in the same encoding as walls. Without
+    // one, floor_material/ceiling_material covers every cell. Material 0 is no floor.
+    std::string floors;
+    std::string ceilings;
+    int floor_material = 0;
+    int ceiling_material = 0;
+    // texture drawn round the player above the horizon wherever no ceiling is, sky_repeats
+    // times round the whole circle; -1 leaves the fog colour
+    int sky_texture = -1;
+    float sky_repeats = 4.0f;
+    // most see-through (MAT_TRANSPARENT) cells drawn per column, further ones are skipped
+    int transparent_hits = 4;
+    std::string atlas = "walls_atlas.png";
+    int atlas_tiles_x = 4;
+    int atlas_tiles_y = 4;
+    // packed atlases (see atlas_packer) list their pages and one rect per texture instead
+    // of a tile grid, padding is the gutter the packer left around every rect
+    std::vector<std::string> atlas_pages;
+    std::vector<AtlasRect> atlas_rects;
+    int atlas_padding = 0;
+    // "auto": BC1 for opaque layers and BC7 for the rest, when the driver has them
+    // "bc1", "bc7": force one, "none": keep RGBA8
+    std::string compression = "auto";
+    // "auto": virtual texturing once a map has more than virtual_texture_threshold
+    // textures, "on"/"off" to force it. Only for atlases with a layer per texture.
+    std::string virtual_texturing = "auto";
+    int virtual_budget_mb = 64;             // physical page cache size
+    // texture index for each (material, face), 4 faces per material
+    std::vector<int> tex_sides = {
+        0, 0, 0, 0,
+        1, 1, 1, 1,
+        2, 2, 2, 2,
+        0, 1, 2, 3
+    };
+    // MaterialFlags for each material
+    std::vector<uint8_t> material_flags = {0, 0, 0, 0};
+    // wall height of each material as a fraction of wall_height
+    std::vector<float> material_heights = {1.0f, 1.0f, 1.0f, 1.0f};
+    // CellShape of each material and its parameter ("offset" of a thin wall, "open"
+    // of a door, "radius" of a pillar)
+    std::vector<uint8_t> material_shapes = {0, 0, 0, 0};
+    std::vector<float> material_shape_params = {0.0f, 0.0f, 0.0f, 0.0f};
+    // index into cameras a material's faces show ("camera" in its entry, which makes
+    // it a MAT_MONITOR), -1 for none
+    std::vector<int> material_cameras = {-1, -1, -1, -1};
+    std::vector<Entity> entities;
+    std::vector<Mover> movers;
+    std::vector<Light> lights;
+    std::vector<Portal> portals;
+    std::vector<SecurityCamera> cameras;
+    float ambient = 0.25f;                  // light every baked face gets without any lights
+    // light_baker's output in the map folder, walls are drawn unlit when it isn't there
+    std::string lightmap = "lightmap.bin";
+    // Rays stop view_distance cells out, 0 for no limit. Fog thickens from fog_start to
+    // where next to nothing shows through at view_distance, so the cut off is never seen.
+    // Past lod_distance textures drop mip levels and far columns are interpolated.
+    // loadMap puts fog_start at half the view distance and lod_distance at a quarter
+    // when the map doesn't set them.
+    float view_distance = 64.0f;
+    float fog_start = -1.0f;
+    float lod_distance = -1.0f;
+    glm::vec3 fog_colour = glm::vec3(0.0f, 0.0f, 0.2f);
+
+    // rays go this far, whatever view_distance says
+    float maxDist() const { return view_distance > 0.0f ? view_distance : 1e30f; }
+    // visibility through the fog is exp(-fogDensity()*(dist - fog_start)), 1/256 at
+    // view_distance
+    float fogDensity() const {
+        return view_distance > fog_start ? std::log(256.0f) / (view_distance - fog_start) : 0.0f;
+    }
+    // mip levels to drop at dist, one more every time the distance doubles
+    float lodBias(float dist) const {
+        return lod_distance > 0.0f && dist > lod_distance ? std::log2(dist / lod_distance) : 0.0f;
+    }
+};
+
+// Streams path through nlohmann's SAX interface straight into manifest, no DOM is built.
+// "material_count" and "entity_count" keys, when present before their arrays, are
+// used to size the tables up front (negative or fractional ones are ignored, and none
+// reserves more entries than the file is long). Unknown keys are skipped.
+bool loadManifest(const std::string& path, MapManifest& manifest);
+
+#endif
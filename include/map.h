@@ -0,0 +1,127 @@
+#ifndef MAP_H
+#define MAP_H
+
+#include "lightmap.h"
+#include "manifest.h"
+#include "material.h"
+#include "sprites.h"
+#include "texture_cache.h"
+#include "virtual_texture.h"
+
+#include <future>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// One entry of the texture rect table, laid out to match the std430 TextureRects
+// block in vColumnShader.glsl
+struct TextureRect {
+    glm::vec4 uv;           // offset in xy, size in zw, normalised to the page
+    float page;
+    float pad[3];
+};
+
+// A wall block part way from one cell to the next, see moving_blocks.h. Both cells hold
+// moving_cell in the grid while it's between them.
+struct MovingBlock {
+    int value = 0;          // cell value it had standing still
+    int x = 0;              // cell it is leaving
+    int y = 0;
+    int dx = 0;             // one cell along x or y
+    int dy = 0;
+    float offset = 0.0f;    // 0-1 of the way into the next cell
+    float speed = 1.0f;     // cells per second
+    int remaining = 0;      // cells to go after the next one
+    int cells = 0;          // length of the whole run
+    bool ping_pong = false; // turns round at each end instead of stopping
+};
+
+// Where a portal face leads, see portals.h. The transform is worked out once when the
+// map loads, so a ray going through is a matrix multiply and a restart of its DDA.
+struct PortalLink {
+    int to_cell = 0;            // index into map.grid of the exit cell
+    int to_side = 0;            // face of it the ray comes out of, RayHit side order
+    int turns = 0;              // quarter turns anticlockwise from the entry to the exit
+    glm::vec2 from_centre;      // middle of the entry face
+    glm::vec2 to_centre;        // middle of the exit face
+    glm::vec2 to_normal;        // out of the exit face
+    glm::mat2 rotation;
+
+    // a point at (or past) the entry face to the same place relative to the exit one,
+    // nudged out of the exit cell so a ray starting there doesn't hit it straight away
+    glm::vec2 point(glm::vec2 p) const { return to_centre + rotation*(p - from_centre) + to_normal*1e-4f; }
+    glm::vec2 direction(glm::vec2 d) const { return rotation*d; }
+};
+
+// Everything that belongs to one level. loadMap only fills in the CPU side,
+// GL objects are created by uploadMap on the thread that owns the context.
+struct Map {
+    std::string name;
+    MapManifest manifest;
+    int width = 0;
+    int height = 0;
+    std::vector<int> grid;
+    std::vector<std::vector<int>> stacked_grids;    // manifest layers, bottom to top
+    float wall_top = 0.0f;                          // world height of the tallest wall
+    // cells holding moving_cell, to the block in moving_blocks that covers them. Only
+    // looked up when a ray enters one of those cells.
+    std::unordered_map<int, int> moving_cells;
+    std::vector<MovingBlock> moving_blocks;
+    // portal faces by entry cell*4 + side, only looked up for block faces a ray hits
+    std::unordered_map<int, PortalLink> portals;
+    MaterialTable materials;
+    // floor texture in the low 16 bits, ceiling texture in the high ones, per cell;
+    // no_floor_texture leaves the clear colour
+    std::vector<uint32_t> floor_cells;
+    Lightmap lightmap;                          // empty when the map hasn't been baked
+    std::vector<Sprite> sprites;                // one per manifest entity
+    // One layer per texture when they all share a size, otherwise one per packed page
+    std::vector<AtlasImage> atlas_layers;
+    bool texture_per_layer = true;
+    std::vector<TextureRect> texture_rects;     // indexed by texture index
+    int atlas_levels = 1;                       // mip levels that go to the GPU
+    unsigned int atlas_texture = 0;             // GL_TEXTURE_2D_ARRAY of atlas_layers
+    unsigned int rects_buffer = 0;              // texture_rects as a shader storage buffer
+    unsigned int floor_buffer = 0;              // floor_cells as a shader storage buffer
+    // Set instead of atlas_layers/atlas_texture for big texture sets, pages stream in
+    // from disk as the column pass asks for them
+    std::unique_ptr<VirtualTexture> virtual_texture;
+};
+
+const uint32_t no_floor_texture = 0xffff;
+
+// Grid value of a cell a moving block is in, the block's own value is in moving_blocks
+const int moving_cell = -1;
+
+// Above this many textures "auto" maps switch to virtual texturing
+const int virtual_texture_threshold = 256;
+
+// Reads maps/<name>/: map.json and atlas.json if there are any, then the walls png into
+// the grid (and any stacked layers) and the atlas pages (or their cache) into atlas_layers
+bool loadMap(const std::string& name, Map& map);
+// Creates the atlas texture and rect buffer in one go, used for the first map
+void uploadMap(Map& map);
+// Deletes the map's GL textures and buffers
+void releaseMap(Map& map);
+
+// Switches maps while the game is running. The next map is loaded on a background
+// thread, its atlas is uploaded a few levels per frame, and the swap itself happens
+// in update() so the render loop never sees a half loaded map.
+class MapStreamer {
+public:
+    // Starts prefetching maps/<name>. Ignored while another switch is still in flight.
+    bool request(const std::string& name);
+    // Call once per frame between frames. Returns true on the frame current was swapped,
+    // the old map's textures have already been released by then.
+    bool update(Map& current);
+    bool busy() const;
+
+private:
+    std::future<std::unique_ptr<Map>> loading;
+    std::unique_ptr<Map> staged;
+    int next_slice = 0;                     // next (level, layer) of staged->atlas_layers to upload
+    size_t upload_budget = 4 << 20;         // bytes of texture data uploaded per frame
+};
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef MAP_EDITS_H
+#define MAP_EDITS_H
+
+#include "map.h"
+
+#include <vector>
+
+// Which of a cell's values an edit replaces
+enum EditTarget : uint8_t {
+    EDIT_WALL,
+    EDIT_FLOOR,
+    EDIT_CEILING,
+};
+
+struct CellEdit {
+    int x = 0;
+    int y = 0;
+    int value = 0;          // cell value, material*4 + rotation
+    int layer = 0;          // walls only: 0 is map.grid, 1 on are map.stacked_grids
+    EditTarget target = EDIT_WALL;
+    int old_value = 0;      // filled in when applied, walls only
+};
+
+// Anything built from the map's cells that follows edits instead of being rebuilt.
+// cellsChanged gets every cell a batch actually changed (writes of the value a cell
+// already had are dropped), after all of them are in the map.
+class MapListener {
+public:
+    virtual ~MapListener() = default;
+    virtual void cellsChanged(const Map& map, const std::vector<CellEdit>& edits) = 0;
+};
+
+// Summed since the counters were last reset
+struct EditTiming {
+    int batches = 0;
+    long cells = 0;             // cells that changed
+    double apply_ms = 0.0;      // writing the grids and the map's own derived data
+    double listeners_ms = 0.0;
+};
+
+// Runtime changes to a map's cells. setCell and friends only queue, nothing in the map
+// moves until apply(), which is meant to run between frames so a frame never sees
+// half an edit. The map's own derived data is kept up to date in place:
+// floor_cells (and its GPU buffer, only over the range that changed), the material
+// table when a new cell value shows up, and wall_top, which only ever grows (a map
+// that lost its tallest wall just has castSpans look a little further than it needs to).
+class MapEditor {
+public:
+    void setCell(int x, int y, int value, int layer=0);
+    void setFloor(int x, int y, int value);
+    void setCeiling(int x, int y, int value);
+    // Writes everything queued into map and tells the listeners. Edits outside the map
+    // or on a layer it doesn't have are dropped.
+    void apply(Map& map);
+    // Forgets queued edits, for when the map they were meant for is swapped out
+    void clear() { queued.clear(); }
+    bool pending() const { return !queued.empty(); }
+
+    // Listeners aren't owned and have to be removed before they go away
+    void addListener(MapListener* listener);
+    void removeListener(MapListener* listener);
+    // Tells the listeners about cells something else already wrote, moving blocks
+    void notify(const Map& map, const std::vector<CellEdit>& edits);
+
+    EditTiming timing;
+
+private:
+    std::vector<CellEdit> queued;
+    std::vector<CellEdit> applied;      // kept to reuse its memory
+    std::vector<MapListener*> listeners;
+};
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include <cstdint>
+#include <vector>
+
+enum MaterialFlags : uint8_t {
+    MAT_TRANSPARENT = 1 << 0,
+    MAT_DOOR        = 1 << 1,
+    MAT_EMISSIVE    = 1 << 2,   // drawn at full brightness, no baked or dynamic light
+    MAT_PUSHWALL    = 1 << 3,   // slides away when the player uses it
+    MAT_MIRROR      = 1 << 4,   // block faces show what a reflected ray sees
+    MAT_MONITOR     = 1 << 5,   // faces show a security camera's view, see security_cameras.h
+};
+
+// Geometry inside a cell. Anything but a block is intersected inside the cell once the
+// ray has entered it, and a ray that misses it carries on into the next cell. The cell
+// rotation turns the shape a quarter at a time, like it does the faces.
+enum CellShape : uint8_t {
+    SHAPE_BLOCK,        // the whole cell, hit on the face the ray enters through
+    SHAPE_THIN,         // a wall across the cell, shape_param in from its west edge
+    SHAPE_DOOR,         // a thin wall through the middle slid shape_param (0-1) of the way open
+    SHAPE_DIAGONAL,     // a thin wall from corner to corner
+    SHAPE_PILLAR,       // a round column in the middle, shape_param is its radius
+};
+
+// Lookup tables indexed by cell value (material*4 + rotation), kept as flat arrays.
+// The cell rotation is baked in when the table is built, so a ray hitting face `side`
+// of a cell only needs face_tex[cell*4 + side].
+struct MaterialTable {
+    std::vector<uint16_t> face_tex;     // 4 per cell value
+    std::vector<uint8_t> flags;         // 1 per cell value
+    std::vector<float> height;          // 1 per cell value, in wall heights
+    std::vector<uint8_t> shape;         // CellShape, 1 per cell value
+    std::vector<float> shape_param;     // 1 per cell value
+
+    int cellCount() const { return flags.size(); }
+};
+
+// tex_sides holds 4 faces per material, the other tables 1 per material. The table is
+// sized for at least cell_count cell values, anything the manifest doesn't describe
+// gets texture 0, no flags and a full height block.
+inline void buildMaterialTable(const std::vector<int>& tex_sides, const std::vector<uint8_t>& material_flags,
+                               const std::vector<float>& material_heights, const std::vector<uint8_t>& material_shapes,
+                               const std::vector<float>& material_shape_params, int cell_count, MaterialTable& table) {
+    int material_count = tex_sides.size()/4;
+    if (cell_count < material_count*4) cell_count = material_count*4;
+    table.face_tex.assign(cell_count*4, 0);
+    table.flags.assign(cell_count, 0);
+    table.height.assign(cell_count, 1.0f);
+    table.shape.assign(cell_count, SHAPE_BLOCK);
+    table.shape_param.assign(cell_count, 0.0f);
+    for (int cell=0; cell<cell_count; cell++) {
+        int material = cell/4;
+        if (material >= material_count) continue;
+        int cell_rotation = cell%4;
+        for (int side=0; side<4; side++) {
+            int rotation = cell_rotation + side;
+            if (rotation >= 4) rotation -= 4;
+            table.face_tex[cell*4 + side] = tex_sides[material*4 + rotation];
+        }
+        if (material < (int)material_flags.size()) table.flags[cell] = material_flags[material];
+        if (material < (int)material_heights.size()) table.height[cell] = material_heights[material];
+        if (material < (int)material_shapes.size()) table.shape[cell] = material_shapes[material];
+        if (material < (int)material_shape_params.size()) table.shape_param[cell] = material_shape_params[material];
+    }
+}
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef MOVING_BLOCKS_H
+#define MOVING_BLOCKS_H
+
+#include "map.h"
+#include "map_edits.h"
+
+#include <vector>
+
+// Starts the wall at (x, y) sliding cells cells along (dx, dy), one of which has to be
+// 0. It moves a cell at a time while the next one is free and settles as a plain wall
+// where it stops, or with ping_pong turns round at each end for good (platforms).
+// Returns false if there is no wall there, it's already moving, or the way is blocked.
+// Both write map.grid straight away, not through a MapEditor; every cell a block takes
+// or lets go of is added to changed, when given, to hand on with MapEditor::notify.
+bool startMoving(Map& map, int x, int y, int dx, int dy, int cells, float speed, bool ping_pong,
+                 std::vector<CellEdit>* changed=nullptr);
+
+// Moves every block on by dt seconds, call once per frame
+void updateMovingBlocks(Map& map, float dt, std::vector<CellEdit>* changed=nullptr);
+
+#endif
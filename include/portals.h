@@ -0,0 +1,17 @@
+#ifndef PORTALS_H
+#define PORTALS_H
+
+#include "map.h"
+
+// Links the portal's entry face to its exit face in map.portals, and the exit back to the
+// entry for two way ones. Either face can be turned any number of quarter turns from the
+// other; a ray or player going in comes out turned the same. Returns false if either
+// cell is off the map.
+bool linkPortal(Map& map, const Portal& portal);
+
+// Moves a player who went from `from` to `to` this frame on through any portal face they
+// crossed into a wall through, turning angle (radians) with them. Returns true if they
+// went through one.
+bool crossPortal(const Map& map, glm::vec2 from, glm::vec2& to, float& angle);
+
+#endif
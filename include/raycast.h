@@ -0,0 +1,101 @@
+#ifndef RAYCAST_H
+#define RAYCAST_H
+
+#include "map.h"
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <vector>
+
+struct RayHit {
+    float dist = 0.0f;      // distance along the normalised ray
+    float tex_x = 0.0f;     // position along the face, wraps every wall_height
+    float face_u = 0.0f;    // 0-1 across the cell face from its low x (or y) end, for the lightmap
+    int cell = -1;          // index into map.grid, -1 when the ray left the map
+    int side = 0;           // face of the cell that was hit, 0-3
+    int tex = 0;            // texture index from the material table
+    uint8_t flags = 0;      // MaterialFlags of the cell
+    glm::vec2 pos;          // where the ray met the face
+    glm::vec2 dir;          // ray direction there, turned by any portals on the way
+    int portal_hops = 0;    // portals the ray went through first, dist counts the whole way
+};
+
+// Outward normal of each RayHit::side: 0 is the west face (hit going +x), 1 south,
+// 2 east, 3 north
+const int face_normal_x[] = {-1, 0, 1, 0};
+const int face_normal_y[] = {0, 1, 0, -1};
+
+// Most portal faces one ray goes through, the next one met is drawn as a plain wall
+const int max_portal_hops = 4;
+
+// DDA through map.grid from start_pos until the first wall: the entry face of a block,
+// or for the other CellShapes whatever part of the shape the ray meets inside the cell.
+// Portal faces (see portals.h) carry the ray on from their exit face, up to
+// max_portal_hops of them.
+// Returns false if the ray left the map, or went max_dist, without hitting anything.
+bool castRay(const Map& map, glm::vec2 start_pos, glm::vec2 ray_dir, RayHit& hit, float max_dist=1e30f);
+
+// castRay as it was before shapes, moving blocks and portals: every non-zero cell is a
+// block hit on its entry face. Only kept for benchmarkShapes to measure what the rest
+// costs maps that are all blocks.
+bool castRayBlocks(const Map& map, glm::vec2 start_pos, glm::vec2 ray_dir, RayHit& hit);
+
+// The part of one wall face a column actually shows
+struct WallSpan {
+    RayHit hit;
+    int layer = 0;              // 0 is map.grid, 1 on are map.stacked_grids
+    float bottom, top;          // screen extent in half wall heights from the eye, the
+                                // vPos.y the column lines take
+    float v_bottom, v_top;      // 0 at the foot of the wall to 1 at its top
+};
+
+// How much one column may produce
+struct SpanBudget {
+    int spans = 16;             // opaque spans
+    int see_through = 4;        // spans of MAT_TRANSPARENT cells, further ones are skipped
+    float max_dist = 1e30f;     // ray distance past which nothing is drawn, MapManifest::maxDist
+    int portal_hops = max_portal_hops;
+};
+
+// Column renderer for walls of any height on any number of stacked layers. Walks the
+// ray front to back through every layer, clips each wall face against the parts of
+// the column nearer walls already cover and appends whatever is left, near to far.
+// Stops once nothing can show any more: the column is covered from the floor up to
+// the top of the tallest wall in the map (so a plain single layer map stops at its
+// first wall, like castRay), the budget is used up or the ray leaves the map.
+// view_cos is dot(ray_dir, view direction), for the fisheye correction.
+// Returns true if the column was covered, with the view depth it happened at in
+// covered_depth; spans and see_through are per frame arenas the caller clears. A column
+// that reaches budget.max_dist counts as covered there, the fog hides anything beyond.
+// A portal face on the ground layer isn't drawn, the walk goes on from its exit face
+// with the distance so far carried over; the floor and ceiling the column pass draws
+// around what is seen through it are still the ones behind the portal's own wall.
+bool castSpans(const Map& map, glm::vec2 start_pos, glm::vec2 ray_dir, float view_cos, float proj_scale,
+               const SpanBudget& budget, std::vector<WallSpan>& spans, std::vector<WallSpan>& see_through,
+               float& covered_depth);
+
+// Secondary rays for mirror faces, shared by all the columns of a frame so a screen full
+// of mirrors costs no more than rays
+struct ReflectionBudget {
+    int rays = 2048;            // left for this frame
+    int bounces = 3;            // most mirrors one view ray is reflected by
+    int used = 0;               // rays cast so far
+};
+
+// Puts what the mirror faces among spans[first..] reflect in place of them. The
+// reflected ray goes through castRay from the point it left the mirror (hit.pos, along
+// hit.dir), and whatever it hits is drawn the distance along the whole path away,
+// clipped to the part of the column the mirror had. Mirrors met on the way reflect
+// again, up to budget.bounces. What the reflection leaves of a mirror (above
+// and below a reflected wall, where the floor and ceiling would be) keeps its own
+// texture, and so does all of it once budget.rays is used up. Only block faces on the
+// ground layer reflect, and sprites don't show up in them. Returns the rays cast.
+int reflectSpans(const Map& map, std::vector<WallSpan>& spans, size_t first, float max_dist, ReflectionBudget& budget);
+
+// The column between two others that each came out as one span of the same plain block
+// face, both at least min_dist away and through as many portals, gets their average in
+// out instead of a ray of its own. False when it needs its own ray, always for a
+// min_dist of 0.
+bool interpolateSpan(const Map& map, const WallSpan& left, const WallSpan& right, float min_dist, WallSpan& out);
+
+#endif
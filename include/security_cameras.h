@@ -0,0 +1,75 @@
+#ifndef SECURITY_CAMERAS_H
+#define SECURITY_CAMERAS_H
+
+#include "camera.h"
+#include "map.h"
+#include "raycast.h"
+#include "shader.h"
+
+#include <vector>
+
+class LightGrid;
+
+// Width and height of every camera's view, in pixels
+const int camera_view_size = 128;
+
+// What refresh() did, summed until it is printed
+struct CameraTiming {
+    int refreshes = 0;
+    double ms = 0.0;        // cpu, rays and line building for the views
+};
+
+// Live views for the faces of monitor materials (a material's "camera" in map.json).
+// Each of the map's cameras has a layer of one texture array, drawn by the same column
+// and floor shaders as the screen at camera_view_size. The column pass adds up how much
+// of the screen each camera's monitors cover, and refresh() only redraws the few that
+// matter most, so any number of monitors costs a bounded amount per frame.
+class SecurityCameras {
+public:
+    CameraTiming timing;
+
+    // GL objects that don't depend on the map
+    void create();
+    void release();
+    // A black layer for every camera of map, the old map's views are dropped
+    void reset(const Map& map);
+
+    // The camera a span's face shows, -1 if it isn't a monitor
+    int cameraOf(const Map& map, const WallSpan& span) const;
+    // Screen pixels of one monitor span, for every one drawn this frame
+    void addCoverage(int camera, float pixels);
+
+    // Redraws up to count cameras into their layers: the ones whose monitors covered the
+    // most of the screen this frame, weighed by the frames since they were last drawn, so
+    // every monitor in sight gets its turn. Monitors nobody saw keep their old picture.
+    // Call after the frame's own passes, it reuses the shader state they left behind (the
+    // atlas, rect and floor buffers, uniforms). It leaves the default framebuffer bound
+    // but the viewport and the Camera block are the caller's to put back. Monitors seen
+    // in a camera's view show their material's texture, and the views have no sprites or
+    // see-through cells. Returns the cameras drawn.
+    int refresh(const Map& map, const LightGrid& lights, Shader& column_shader, Shader& floor_shader,
+                const CameraBuffer& camera, float time, int count);
+    // The views as a GL_TEXTURE_2D_ARRAY on texture unit `unit`, layer = camera
+    void bind(int unit) const;
+
+private:
+    struct View {
+        float coverage = 0.0f;
+        int age = 0;            // frames since it was drawn
+    };
+    std::vector<View> views;
+    std::vector<int> order;
+    std::vector<WallSpan> spans;
+    std::vector<WallSpan> see_through;
+    std::vector<float> lines;
+    size_t lines_capacity = 0;
+    unsigned int texture = 0;
+    unsigned int framebuffer = 0;
+    unsigned int depth = 0;
+    unsigned int lines_vao = 0;
+    unsigned int lines_vbo = 0;
+    unsigned int quad_vao = 0;
+    unsigned int quad_vbo = 0;
+};
+
+#endif
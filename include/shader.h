@@ -3,11 +3,18 @@
 
 #include "glad/glad.h" // include glad to get all the required OpenGL headers
 #include "glm/glm.hpp"
+#include "assets.h"
+#include "hash.h"
 
+#include <cstring>
+#include <filesystem>
 #include <string>
+#include <string_view>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <unordered_map>
+#include <vector>
 
 
 class Shader {
@@ -16,34 +23,32 @@ public:
     unsigned int ID;
 
     Shader(const char* vertexPath, const char* fragmentPath) {
-        // 1. retrieve the vertex/fragment source code from filePath
-        std::string vertexCode;
-        std::string fragmentCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        try
-        {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode   = vShaderStream.str();
-            fragmentCode = fShaderStream.str();
+        // 1. retrieve the vertex/fragment source code, from the embedded pack when there is one
+        Asset vertexAsset, fragmentAsset;
+        if (!loadAsset(vertexPath, vertexAsset) || !loadAsset(fragmentPath, fragmentAsset)) {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
         }
-        catch(std::ifstream::failure e)
-        {
+        Asset commonAsset;
+        if (!loadAsset("src/shaders/common.glsl", commonAsset)) {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
         }
+        std::string vertexCode = withCommon(vertexAsset.text(), commonAsset.text());
+        std::string fragmentCode = withCommon(fragmentAsset.text(), commonAsset.text());
+
+        // a linked binary is only valid for the driver that produced it, so that is part of the key
+        std::string key = vertexCode + '\0' + fragmentCode + '\0';
+        for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+            const char* value = (const char*)glGetString(name);
+            if (value) key += value;
+        }
+        std::stringstream cache_path;
+        cache_path << "cache/shaders/" << std::hex << hashBytes(key.data(), key.size()) << ".bin";
+        ID = glCreateProgram();
+        if (loadBinary(cache_path.str())) {
+            cacheUniforms();
+            return;
+        }
+
         const char* vShaderCode = vertexCode.c_str();
         const char* fShaderCode = fragmentCode.c_str();
 
@@ -70,18 +75,22 @@ public:
             std::cout << "Error: compilation of " << fragmentPath << " failed.\n" << infoLog << "\n";
         }
         // create shader program
-        ID = glCreateProgram();
         glAttachShader(ID, vertex);
         glAttachShader(ID, fragment);
+        glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
         glLinkProgram(ID);
         glGetProgramiv(ID, GL_LINK_STATUS, &success);
         if(!success) {
             glGetProgramInfoLog(ID, 512, NULL, infoLog);
             std::cout << "Error: Shader program compillation failed.\n" << infoLog << "\n";
         }
+        else saveBinary(cache_path.str());
         // delete shaders
+        glDetachShader(ID, vertex);
+        glDetachShader(ID, fragment);
         glDeleteShader(vertex);
         glDeleteShader(fragment);
+        cacheUniforms();
     }
 
     void use() {
@@ -92,111 +101,203 @@ public:
         glDeleteProgram(ID);
     }
 
+    // Location from the table built at link time, -1 (ignored by glUniform*) if the
+    // program has no such uniform. Hot loops can look it up once and use the int setters.
+    int location(const std::string &name) const
+    {
+        auto it = uniforms.find(name);
+        return it != uniforms.end() ? it->second : -1;
+    }
+
     void setBool(const std::string &name, bool value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+        glUniform1i(location(name), (int)value);
+    }
+    void setBool(int loc, bool value) const
+    {
+        glUniform1i(loc, (int)value);
     }
     void setInt(const std::string &name, int value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+        glUniform1i(location(name), value);
+    }
+    void setInt(int loc, int value) const
+    {
+        glUniform1i(loc, value);
     }
 
 
     // Floats
     void setFloat(const std::string &name, float value) const
     {
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+        glUniform1f(location(name), value);
+    }
+    void setFloat(int loc, float value) const
+    {
+        glUniform1f(loc, value);
     }
     // ------------------------------------------------------------------------
     void setVec2(const std::string &name, const glm::vec2 &value) const
     {
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform2fv(location(name), 1, &value[0]);
     }
     void setVec2(const std::string &name, float x, float y) const
     {
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+        glUniform2f(location(name), x, y);
+    }
+    void setVec2(int loc, const glm::vec2 &value) const
+    {
+        glUniform2fv(loc, 1, &value[0]);
     }
     // ------------------------------------------------------------------------
     void setVec3(const std::string &name, const glm::vec3 &value) const
     {
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform3fv(location(name), 1, &value[0]);
     }
     void setVec3(const std::string &name, float x, float y, float z) const
     {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+        glUniform3f(location(name), x, y, z);
+    }
+    void setVec3(int loc, const glm::vec3 &value) const
+    {
+        glUniform3fv(loc, 1, &value[0]);
     }
     // ------------------------------------------------------------------------
     void setVec4(const std::string &name, const glm::vec4 &value) const
     {
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform4fv(location(name), 1, &value[0]);
     }
     void setVec4(const std::string &name, float x, float y, float z, float w) const
     {
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+        glUniform4f(location(name), x, y, z, w);
     }
     // ------------------------------------------------------------------------
     void setMat2(const std::string &name, const glm::mat2 &mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix2fv(location(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat3(const std::string &name, const glm::mat3 &mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix3fv(location(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat4(const std::string &name, const glm::mat4 &mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix4fv(location(name), 1, GL_FALSE, &mat[0][0]);
     }
 
 
     // Doubles
     void setDouble(const std::string &name, double value) const
     {
-        glUniform1d(glGetUniformLocation(ID, name.c_str()), value);
+        glUniform1d(location(name), value);
     }
     // ------------------------------------------------------------------------
     void setDVec2(const std::string &name, const glm::dvec2 &value) const
     {
-        glUniform2dv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform2dv(location(name), 1, &value[0]);
     }
     void setDVec2(const std::string &name, double x, double y) const
     {
-        glUniform2d(glGetUniformLocation(ID, name.c_str()), x, y);
+        glUniform2d(location(name), x, y);
     }
     // ------------------------------------------------------------------------
     void setDVec3(const std::string &name, const glm::dvec3 &value) const
     {
-        glUniform3dv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform3dv(location(name), 1, &value[0]);
     }
     void setDVec3(const std::string &name, double x, double y, double z) const
     {
-        glUniform3d(glGetUniformLocation(ID, name.c_str()), x, y, z);
+        glUniform3d(location(name), x, y, z);
     }
     // ------------------------------------------------------------------------
     void setDVec4(const std::string &name, const glm::dvec4 &value) const
     {
-        glUniform4dv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform4dv(location(name), 1, &value[0]);
     }
     void setDVec4(const std::string &name, double x, double y, double z, double w) const
     {
-        glUniform4d(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+        glUniform4d(location(name), x, y, z, w);
     }
     // ------------------------------------------------------------------------
     void setDMat2(const std::string &name, const glm::dmat2 &mat) const
     {
-        glUniformMatrix2dv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix2dv(location(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setDMat3(const std::string &name, const glm::dmat3 &mat) const
     {
-        glUniformMatrix3dv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix3dv(location(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setDMat4(const std::string &name, const glm::dmat4 &mat) const
     {
-        glUniformMatrix4dv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix4dv(location(name), 1, GL_FALSE, &mat[0][0]);
+    }
+
+private:
+    std::unordered_map<std::string, int> uniforms;
+
+    // common.glsl (the Camera block, texture rects, virtual texture tables) goes right
+    // after the #version line, and #line puts the error line numbers back on the file's own
+    static std::string withCommon(std::string_view code, std::string_view common)
+    {
+        size_t eol = code.find('\n');
+        if (eol == std::string_view::npos) return std::string(code);
+        std::string out(code.substr(0, eol+1));
+        out += common;
+        out += "\n#line 2\n";
+        out += code.substr(eol+1);
+        return out;
+    }
+
+    // Program binary cache file: format enum, then the driver's blob
+    bool loadBinary(const std::string &path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) return false;
+        GLenum format = 0;
+        if (!file.read((char*)&format, sizeof(format))) return false;
+        std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        glProgramBinary(ID, format, binary.data(), binary.size());
+        int success;
+        glGetProgramiv(ID, GL_LINK_STATUS, &success);
+        // a driver update rejects old binaries, the sources get compiled again instead
+        return success;
+    }
+    void saveBinary(const std::string &path) const
+    {
+        int formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        int length = 0;
+        glGetProgramiv(ID, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (formats == 0 || length == 0) return;
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        glGetProgramBinary(ID, length, &length, &format, binary.data());
+        std::error_code ec;
+        std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write((const char*)&format, sizeof(format));
+        file.write(binary.data(), length);
+    }
+    void cacheUniforms()
+    {
+        int count = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        char name[256];
+        for (int i=0; i<count; i++) {
+            int length, size;
+            GLenum type;
+            glGetActiveUniform(ID, i, sizeof(name), &length, &size, &type, name);
+            int loc = glGetUniformLocation(ID, name);
+            if (loc < 0) continue;      // members of uniform blocks
+            std::string key(name, length);
+            // arrays are reported as "name[0]", look them up by the plain name as well
+            if (key.size() > 3 && key.compare(key.size()-3, 3, "[0]") == 0) uniforms[key.substr(0, key.size()-3)] = loc;
+            uniforms[key] = loc;
+        }
     }
 };
 
@@ -0,0 +1,55 @@
+#ifndef SOFTWARE_RENDER_H
+#define SOFTWARE_RENDER_H
+
+#include "map.h"
+#include "glm/glm.hpp"
+
+#include <vector>
+
+class LightGrid;
+
+// View for the CPU renderer, same conventions as the column pass: dir is normalised,
+// plane spans half the screen width and proj_scale is 1/(2*tan(vfov/2))
+struct SoftwareView {
+    glm::vec2 pos;
+    glm::vec2 dir;
+    glm::vec2 plane;
+    float proj_scale;
+};
+
+// RGBA8, row 0 at the top
+struct SoftwareFrame {
+    int width = 0;
+    int height = 0;
+    std::vector<unsigned char> pixels;
+
+    void resize(int w, int h) {
+        width = w;
+        height = h;
+        pixels.assign((size_t)w*h*4, 0);
+    }
+};
+
+// Where castFloorsCPU spent its time, summed over the frame
+struct FloorTiming {
+    double setup_ms = 0.0;      // row distance, mip level and span start/step
+    double address_ms = 0.0;    // SIMD world position to cell and texel addresses
+    double shade_ms = 0.0;      // texel fetches into the frame
+    long pixels = 0;
+};
+
+// Floor and ceiling casting one horizontal scanline at a time, for running without a GL
+// context. Floor row y and ceiling row height-1-y see the same distance, so they share
+// their addresses and only differ in the texture they fetch from. Needs map.atlas_layers
+// as same size RGBA8 layers (no compression, no virtual texturing); returns false otherwise.
+// Rows past the map's view distance are left alone, the frame should start out in its
+// fog colour.
+bool castFloorsCPU(const Map& map, const SoftwareView& view, SoftwareFrame& frame, FloorTiming& timing);
+
+// The wall spans of every column through castSpans, drawn over whatever is in frame.
+// See-through cells are left out, lights (when given) add to the lightmap like in the
+// column pass, and so do the fog, the far column interpolation and the mirrors (with a
+// default ReflectionBudget). Returns the number of spans drawn.
+int castWallsCPU(const Map& map, const SoftwareView& view, SoftwareFrame& frame, const LightGrid* lights=nullptr);
+
+#endif
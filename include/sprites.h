@@ -0,0 +1,70 @@
+#ifndef SPRITES_H
+#define SPRITES_H
+
+#include "column_hiz.h"
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// A billboard standing on the floor, always turned to face the camera
+struct Sprite {
+    glm::vec2 pos;
+    float size;         // width and height in world units
+    int tex;            // texture index, same table as the wall materials
+};
+
+// One instance of the sprite draw, matches the instance attribute of vSpriteShader.glsl
+struct SpriteInstance {
+    glm::vec2 pos;
+    float size;
+    float tex;
+};
+
+// Last frame's cull and sort
+struct SpriteStats {
+    int total = 0;
+    int visible = 0;
+    int occluded = 0;       // in view but behind walls across their whole width
+    double cull_ms = 0.0;
+    double sort_ms = 0.0;
+};
+
+// LSD radix sort of 64 bit items by their upper 32 bits, 8 bits a pass. The lower half
+// carries whatever the caller needs back (an index). scratch is the ping-pong buffer.
+void radixSortHigh32(std::vector<uint64_t>& items, std::vector<uint64_t>& scratch);
+
+// Draws every sprite of a map in a single instanced call. The CPU only culls and sorts;
+// the shader projects each quad with the camera block and hides the parts behind a
+// wall by comparing against the column depth buffer the ray loop fills in.
+class SpriteRenderer {
+public:
+    std::vector<SpriteInstance> visible;        // sorted far to near by cull()
+    SpriteStats stats;
+
+    void create();
+    void release();
+
+    // Drops sprites behind the camera, off the sides of the screen or (with hiz) behind
+    // walls in every column they cover, and sorts the rest far to near, so they can be
+    // drawn in painter's order without writing depth. Same view conventions as the
+    // column pass.
+    void cull(const std::vector<Sprite>& sprites, glm::vec2 pos, glm::vec2 dir, glm::vec2 plane,
+              const ColumnHiZ* hiz = nullptr);
+    // Distance to the wall of every framebuffer column, along the view direction
+    void setColumnDepth(const std::vector<float>& depth);
+    // Needs the sprite shader in use and the texture bound, like the column pass
+    void draw();
+
+private:
+    std::vector<uint64_t> keys;
+    std::vector<uint64_t> scratch;
+    unsigned int vao = 0;
+    unsigned int quad_vbo = 0;
+    unsigned int instance_vbo = 0;
+    unsigned int depth_buffer = 0;
+    size_t instance_capacity = 0;
+    size_t depth_capacity = 0;
+};
+
+#endif
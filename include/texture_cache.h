@@ -0,0 +1,74 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include "hash.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum TextureFormat : uint32_t {
+    TEX_RGBA8 = 0,
+    TEX_BC1 = 1,        // 8 bytes per 4x4 block, 1 bit alpha
+    TEX_BC7 = 2,        // 16 bytes per 4x4 block
+};
+
+// Bytes needed for a w x h level in the given format
+inline size_t levelBytes(uint32_t format, int w, int h) {
+    if (format == TEX_RGBA8) return (size_t)w*h*4;
+    size_t blocks = (size_t)((w+3)/4) * ((h+3)/4);
+    return blocks * (format == TEX_BC1 ? 8 : 16);
+}
+
+// Decoded atlas plus its mip chain, ready to be uploaded.
+// Levels are tightly packed in `format`, level 0 first. Everything that filters or
+// cuts images expects TEX_RGBA8, compression is the last step before upload.
+struct AtlasImage {
+    int width = 0;
+    int height = 0;
+    int tiles_x = 1;
+    int tiles_y = 1;
+    uint32_t format = TEX_RGBA8;
+    std::vector<std::vector<unsigned char>> levels;
+
+    int tileWidth(int level) const { int w = (width/tiles_x) >> level; return w > 0 ? w : 1; }
+    int tileHeight(int level) const { int h = (height/tiles_y) >> level; return h > 0 ? h : 1; }
+    int levelWidth(int level) const { return tileWidth(level) * tiles_x; }
+    int levelHeight(int level) const { return tileHeight(level) * tiles_y; }
+    size_t levelSize(int level) const { return levelBytes(format, levelWidth(level), levelHeight(level)); }
+};
+
+// "cache/textures/<hash>-<suffix>.rtex"
+std::string textureCachePath(uint64_t hash, const std::string& suffix);
+
+// Extends img.levels from the last level it has (level 0 for a fresh image). Each tile
+// is filtered on its own and the chain stops once a tile is a single texel, so no level
+// ever mixes two tiles. It also stops at the first level GL would size differently
+// (tiles that aren't a power of two), so the chain can always be uploaded whole.
+void buildTileMips(AtlasImage& img);
+
+// Raw mip container, laid out like a stripped down KTX2: header, level index
+// (offset + size per level), then the level data in the image's format.
+bool readTextureCache(const std::string& path, uint64_t source_hash, AtlasImage& img);
+bool writeTextureCache(const std::string& path, uint64_t source_hash, const AtlasImage& img);
+
+// Decodes png_path and builds its mips, or reads them straight from the cache
+// (keyed by the png's hash and the tile layout) when the cached copy was built from
+// identical file contents. Doesn't touch GL, so it is safe to call off the main thread.
+bool loadAtlasImage(const std::string& png_path, int tiles_x, int tiles_y, AtlasImage& img);
+
+// Cuts every tile of a grid atlas into its own image. The tile-aware chain already
+// holds each tile's mips, so this is just copying, nothing is filtered again.
+void splitTiles(const AtlasImage& atlas, std::vector<AtlasImage>& tiles);
+
+// Copies a w x h rect out of level 0 of page and builds a full mip chain for it
+void extractRect(const AtlasImage& page, int x, int y, int w, int h, AtlasImage& out);
+
+// Allocates immutable storage for a GL_TEXTURE_2D_ARRAY with `layers` layers shaped
+// like img and `levels` mip levels, and leaves it bound. Fill it with uploadAtlasLevel.
+unsigned int createAtlasArray(const AtlasImage& img, int layers, int levels);
+
+// Uploads one level of img into a layer of the bound GL_TEXTURE_2D_ARRAY
+void uploadAtlasLevel(const AtlasImage& img, int layer, int level);
+
+#endif
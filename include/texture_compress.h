@@ -0,0 +1,27 @@
+#ifndef TEXTURE_COMPRESS_H
+#define TEXTURE_COMPRESS_H
+
+#include "texture_cache.h"
+
+#include <string>
+
+// CPU block compression for the atlas layers. Each encoder takes a w x h RGBA8 image
+// and writes ((w+3)/4) * ((h+3)/4) blocks, edge blocks repeat the last row/column.
+void encodeBC1(const unsigned char* rgba, int w, int h, unsigned char* out);
+void encodeBC7(const unsigned char* rgba, int w, int h, unsigned char* out);
+
+// Queries which block formats the current context accepts. Call once on the main
+// thread after GL is loaded, until then everything stays RGBA8.
+void detectCompressionSupport();
+
+// Format for img under the map's "compression" setting ("auto", "bc1", "bc7", "none"),
+// falling back to RGBA8 when the driver can't take it. auto picks BC1 for opaque
+// images and BC7 for anything with alpha.
+TextureFormat chooseFormat(const AtlasImage& img, const std::string& mode);
+
+// Compresses every level of an RGBA8 img to format. The result is cached under the hash
+// of img's level 0, its size and the encoder version, so only the first run with a
+// given texture pays for encoding.
+void compressImage(AtlasImage& img, TextureFormat format);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef TEXTURE_FEEDBACK_H
+#define TEXTURE_FEEDBACK_H
+
+#include "map.h"
+#include "software_render.h"
+#include "sprites.h"
+#include "virtual_texture.h"
+
+#include <vector>
+
+// Virtual texture page requests for the passes that aren't wall columns (those ask for
+// theirs span by span in the ray loop). The shaders only find the pages somebody asked
+// for, anything else comes from the pinned mip tails, so every pass that samples the
+// virtual texture works out on the CPU which pages it is going to touch.
+
+// Floors and ceilings, from a grid of screen points every few pixels, each at the mip
+// level the floor shader picks there. Points farther than the wall of their column
+// (column_depth, along the view direction) are taken as covered.
+void requestFloorPages(const Map& map, VirtualTexture& vt, const SoftwareView& view, int width, int height,
+                       const std::vector<float>& column_depth);
+
+// Sprites, after SpriteRenderer::cull: every visible sprite's whole texture at the level
+// its size on screen picks. The cull already dropped the ones the walls hide.
+void requestSpritePages(const Map& map, VirtualTexture& vt, const SoftwareView& view, int width, int height,
+                        const std::vector<SpriteInstance>& sprites);
+
+// The sky cylinder across the field of view, all the way from the top of the screen to
+// the horizon. view_angle and fov in radians, like the sky shader's.
+void requestSkyPages(const Map& map, VirtualTexture& vt, float view_angle, float fov, int width, int height);
+
+#endif
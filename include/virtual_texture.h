@@ -0,0 +1,124 @@
+#ifndef VIRTUAL_TEXTURE_H
+#define VIRTUAL_TEXTURE_H
+
+#include "texture_cache.h"
+#include "glm/glm.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Matches the ivec4s of the VirtualTextures / VirtualLevels blocks in common.glsl
+struct VirtualTextureInfo {
+    int32_t level_base;         // first entry of this texture in the level table
+    int32_t level_count;        // levels down to and including the mip tail
+    int32_t width;
+    int32_t height;
+};
+
+struct VirtualLevelInfo {
+    int32_t page_base;          // first page of this level in the page table
+    int32_t pages_x;
+    int32_t pages_y;
+    int32_t pad;
+};
+
+// Virtual texturing for texture sets too big to keep resident. Every level of every
+// texture is cut into page_size pages (plus a border for bilinear filtering) that live
+// in a page file under cache/textures. Only the pages the passes ask for are
+// loaded, by a background thread, into a fixed size physical cache (a texture array
+// with one page per layer). The shader finds them through the page table and falls
+// back to coarser levels for anything not resident yet; the mip tail of every texture
+// is pinned so that always ends somewhere.
+//
+// Only plain GL 4.3 objects are used (texture arrays and storage buffers, no sparse
+// textures), so it runs the same on software implementations like llvmpipe.
+class VirtualTexture {
+public:
+    static const int page_size = 128;       // texels of content per page side
+    static const int page_border = 1;
+    static const int physical_size = page_size + 2*page_border;
+    // GL_MAX_ARRAY_TEXTURE_LAYERS is at least this on any GL 4.6 driver, build() has to
+    // go by it as it can run before there is a context to ask
+    static const int min_array_layers = 2048;
+
+    ~VirtualTexture();
+
+    // Writes the page file for layers (or finds it in the cache) and fills the tables.
+    // CPU only, safe on a loader thread. layers can be dropped afterwards. False, for the
+    // plain atlas array instead, when the pinned tails and the streaming pages wouldn't
+    // fit in min_array_layers physical pages.
+    bool build(const std::vector<AtlasImage>& layers, int levels);
+    // Creates the physical cache with as many pages as fit in vram_budget bytes, uploads
+    // the pinned mip tails and starts the streaming thread. Needs the GL context.
+    void create(size_t vram_budget);
+    void release();
+
+    // Column pass feedback: `texture` is visible from v_min to v_max (0-1) at u, drawn
+    // line_height pixels tall. Records the pages that column samples.
+    void request(int texture, float u, float v_min, float v_max, float line_height);
+    // Feedback for the other passes (see texture_feedback.h): the pages of `texture` from
+    // uv_min to uv_max (wrapping past 1 like the shaders' fract), at the level the shader
+    // picks from its per pixel uv derivatives dx and dy and the lod bias.
+    void requestArea(int texture, glm::vec2 uv_min, glm::vec2 uv_max, glm::vec2 dx, glm::vec2 dy, float bias);
+    // Once per frame: queues this frame's missing pages for the streamer, uploads the
+    // ones it finished and pushes the page table if it changed.
+    void update();
+    // Physical cache on unit 0, tables on storage buffer bindings 1-3
+    void bind() const;
+
+    int textureCount() const { return textures.size(); }
+    int residentPages() const { return resident; }
+
+private:
+    struct Slot {
+        int page = -1;
+        uint32_t last_used = 0;
+        bool pinned = false;
+    };
+    struct LoadedPage {
+        int page;
+        std::vector<unsigned char> pixels;
+    };
+
+    std::vector<VirtualTextureInfo> textures;
+    std::vector<VirtualLevelInfo> levels;
+    std::vector<int32_t> page_table;            // physical slot of every virtual page, -1 if absent
+    std::vector<uint32_t> page_frame;           // frame a page was last requested in
+    std::vector<uint8_t> page_queued;
+    std::vector<uint8_t> page_level;            // coarse levels are loaded first
+    std::string page_path;
+    std::vector<std::vector<unsigned char>> tail_pages;     // pinned pages, freed after create()
+
+    std::vector<Slot> slots;
+    int resident = 0;
+    uint32_t frame = 1;
+    std::vector<int> missing;
+    bool table_dirty = false;
+    size_t uploads_per_frame = 32;
+
+    unsigned int cache_texture = 0;
+    unsigned int textures_buffer = 0;
+    unsigned int levels_buffer = 0;
+    unsigned int pages_buffer = 0;
+
+    // shared with the streaming thread
+    std::thread streamer;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::deque<int> load_queue;
+    std::vector<LoadedPage> loaded;
+    bool stopping = false;
+
+    void stream();
+    // marks a page as used this frame, queueing it if it isn't resident
+    void want(int page);
+    int pageOf(int texture, int level, int page_x, int page_y) const;
+    int claimSlot();
+};
+
+#endif
@@ -0,0 +1,53 @@
+#include "../include/assets.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace {
+
+const EmbeddedAsset* findEmbedded(const std::string& path) {
+    const EmbeddedAsset* end = embedded_assets + embedded_asset_count;
+    const EmbeddedAsset* it = std::lower_bound(embedded_assets, end, path, [](const EmbeddedAsset& asset, const std::string& key) {
+        return std::strcmp(asset.path, key.c_str()) < 0;
+    });
+    if (it == end || path != it->path) return nullptr;
+    return it;
+}
+
+bool loadLoose(const std::string& path, Asset& asset) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) return false;
+    std::streamsize size = file.tellg();
+    file.seekg(0);
+    // one extra 0 byte, same as the embedded copies, so text can be handed to C APIs
+    asset.storage.assign(size + 1, 0);
+    if (!file.read((char*)asset.storage.data(), size)) return false;
+    asset.data = asset.storage.data();
+    asset.size = size;
+    return true;
+}
+
+#ifdef LOOSE_ASSETS
+const bool loose_first = true;
+#else
+const bool loose_first = false;
+#endif
+
+}
+
+bool loadAsset(const std::string& path, Asset& asset) {
+    asset = Asset();
+    if (loose_first && loadLoose(path, asset)) return true;
+    if (const EmbeddedAsset* embedded = findEmbedded(path)) {
+        asset.data = embedded->data;
+        asset.size = embedded->size;
+        return true;
+    }
+    return !loose_first && loadLoose(path, asset);
+}
+
+bool assetExists(const std::string& path) {
+    return findEmbedded(path) != nullptr || std::filesystem::exists(path);
+}
@@ -0,0 +1,58 @@
+#include "../include/column_hiz.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+const float far_depth = std::numeric_limits<float>::max();
+
+}
+
+void ColumnHiZ::build(const std::vector<float>& depth) {
+    count = depth.size();
+    size = 1;
+    while (size < count) size *= 2;
+    max_tree.resize(size*2);
+    min_tree.resize(size*2);
+    // padding leaves past the last column are never inside a clamped range
+    std::copy(depth.begin(), depth.end(), max_tree.begin() + size);
+    std::copy(depth.begin(), depth.end(), min_tree.begin() + size);
+    std::fill(max_tree.begin() + size + count, max_tree.end(), far_depth);
+    std::fill(min_tree.begin() + size + count, min_tree.end(), far_depth);
+    for (int i=size-1; i>0; i--) {
+        max_tree[i] = std::max(max_tree[2*i], max_tree[2*i+1]);
+        min_tree[i] = std::min(min_tree[2*i], min_tree[2*i+1]);
+    }
+}
+
+float ColumnHiZ::maxDepth(int first, int last) const {
+    if (count == 0) return far_depth;
+    first = std::max(first, 0);
+    last = std::min(last, count-1);
+    float result = 0.0f;
+    // walk up from both ends, taking whole nodes that lie inside the range
+    for (int l=first+size, r=last+size+1; l<r; l/=2, r/=2) {
+        if (l & 1) result = std::max(result, max_tree[l++]);
+        if (r & 1) result = std::max(result, max_tree[--r]);
+    }
+    return result;
+}
+
+float ColumnHiZ::minDepth(int first, int last) const {
+    first = std::max(first, 0);
+    last = std::min(last, count-1);
+    float result = far_depth;
+    for (int l=first+size, r=last+size+1; l<r; l/=2, r/=2) {
+        if (l & 1) result = std::min(result, min_tree[l++]);
+        if (r & 1) result = std::min(result, min_tree[--r]);
+    }
+    return result;
+}
+
+void ColumnHiZ::columnRange(float x_min, float x_max, int& first, int& last) const {
+    // column i is cast at camera_x = 2i/columns - 1, the same as the ray loop
+    first = std::clamp((int)std::floor((x_min + 1.0f) * 0.5f * count), 0, count-1);
+    last = std::clamp((int)std::floor((x_max + 1.0f) * 0.5f * count), 0, count-1);
+}
@@ -0,0 +1,203 @@
+#include "../include/light_grid.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+void LightGrid::reset(const Map& map) {
+    width = map.width;
+    height = map.height;
+    levels.assign((size_t)width*height, 0);
+    source_levels.assign((size_t)width*height, 0);
+    sources.clear();
+    free_ids.clear();
+    dark_queue.clear();
+    light_queue.clear();
+}
+
+int LightGrid::addLight(glm::vec2 pos, int level) {
+    int id;
+    if (!free_ids.empty()) {
+        id = free_ids.back();
+        free_ids.pop_back();
+    }
+    else {
+        id = sources.size();
+        sources.emplace_back();
+    }
+    Source& source = sources[id];
+    source.used = true;
+    source.cell = -1;
+    source.level = std::clamp(level, 0, max_light_level);
+    moveLight(id, pos);
+    return id;
+}
+
+void LightGrid::moveLight(int id, glm::vec2 pos) {
+    if (id < 0 || id >= (int)sources.size() || !sources[id].used) return;
+    int x = (int)std::floor(pos.x);
+    int y = (int)std::floor(pos.y);
+    int cell = x >= 0 && x < width && y >= 0 && y < height ? y*width + x : -1;
+    Source& source = sources[id];
+    if (cell == source.cell) return;
+    int old_cell = source.cell;
+    source.cell = cell;
+    if (old_cell >= 0) take(old_cell);
+    if (cell >= 0) place(cell, source.level);
+}
+
+void LightGrid::setLevel(int id, int level) {
+    if (id < 0 || id >= (int)sources.size() || !sources[id].used) return;
+    Source& source = sources[id];
+    level = std::clamp(level, 0, max_light_level);
+    if (level == source.level) return;
+    source.level = level;
+    if (source.cell < 0) return;
+    take(source.cell);
+    place(source.cell, level);
+}
+
+void LightGrid::removeLight(int id) {
+    if (id < 0 || id >= (int)sources.size() || !sources[id].used) return;
+    int cell = sources[id].cell;
+    sources[id] = Source();
+    free_ids.push_back(id);
+    if (cell >= 0) take(cell);
+}
+
+int LightGrid::sourceLevel(int cell) const {
+    int level = 0;
+    for (const Source& source : sources) {
+        if (source.used && source.cell == cell) level = std::max(level, source.level);
+    }
+    return level;
+}
+
+bool LightGrid::opaque(const Map& map, int cell) const {
+    int value = map.grid[cell];
+    if (value == 0) return false;
+    if (value == moving_cell || value >= map.materials.cellCount()) return true;
+    return map.materials.shape[value] == SHAPE_BLOCK && !(map.materials.flags[value] & MAT_TRANSPARENT);
+}
+
+void LightGrid::place(int cell, int level) {
+    source_levels[cell] = std::max<int>(source_levels[cell], level);
+    if (levels[cell] < level) {
+        levels[cell] = level;
+        light_queue.push_back(cell);
+    }
+}
+
+void LightGrid::take(int cell) {
+    source_levels[cell] = sourceLevel(cell);
+    if (levels[cell] <= source_levels[cell]) return;
+    // whatever the cell still gets from the lights around it comes back through the
+    // refill once the clearing is done
+    dark_queue.emplace_back(cell, levels[cell]);
+    levels[cell] = source_levels[cell];
+    if (levels[cell] > 0) light_queue.push_back(cell);
+}
+
+int LightGrid::update(const Map& map, int budget) {
+    if (!pending() || map.width != width || map.height != height) return 0;
+    auto start = std::chrono::steady_clock::now();
+    int done = 0;
+    auto neighbours = [&](int cell, auto&& visit) {
+        int x = cell % width;
+        int y = cell / width;
+        if (x > 0) visit(cell - 1);
+        if (x < width-1) visit(cell + 1);
+        if (y > 0) visit(cell - width);
+        if (y < height-1) visit(cell + width);
+    };
+
+    // clear every cell that was lit through one that went dark, the brighter cells met
+    // at the edge of that are lit from elsewhere and get queued to flood back in
+    while (!dark_queue.empty() && done < budget) {
+        auto [cell, old_level] = dark_queue.front();
+        dark_queue.pop_front();
+        done++;
+        neighbours(cell, [&](int next) {
+            int level = levels[next];
+            if (level == 0) return;
+            if (level < old_level && source_levels[next] < level) {
+                dark_queue.emplace_back(next, level);
+                levels[next] = source_levels[next];
+                if (levels[next] > 0) light_queue.push_back(next);
+            }
+            else light_queue.push_back(next);
+        });
+    }
+    while (dark_queue.empty() && !light_queue.empty() && done < budget) {
+        int cell = light_queue.front();
+        light_queue.pop_front();
+        done++;
+        int spread = levels[cell] - 1;
+        // a wall only shines if a light stands in it, anything else in one is left over
+        if (spread <= 0 || (opaque(map, cell) && source_levels[cell] == 0)) continue;
+        neighbours(cell, [&](int next) {
+            if (levels[next] >= spread || opaque(map, next)) return;
+            levels[next] = spread;
+            light_queue.push_back(next);
+        });
+    }
+
+    timing.updates++;
+    timing.cells += done;
+    timing.ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return done;
+}
+
+void LightGrid::cellsChanged(const Map& map, const std::vector<CellEdit>& edits) {
+    if (map.width != width || map.height != height) return;
+    for (const CellEdit& edit : edits) {
+        if (edit.target != EDIT_WALL || edit.layer != 0) continue;
+        int cell = edit.y*width + edit.x;
+        if (opaque(map, cell)) {
+            // a new wall: darken out from it like from a light going out
+            if (levels[cell] > source_levels[cell]) {
+                dark_queue.emplace_back(cell, levels[cell]);
+                levels[cell] = source_levels[cell];
+            }
+            continue;
+        }
+        // an opened cell: the lights next to it flood in
+        int x = edit.x;
+        int y = edit.y;
+        if (source_levels[cell] > levels[cell]) levels[cell] = source_levels[cell];
+        if (levels[cell] > 0) light_queue.push_back(cell);
+        if (x > 0) light_queue.push_back(cell - 1);
+        if (x < width-1) light_queue.push_back(cell + 1);
+        if (y > 0) light_queue.push_back(cell - width);
+        if (y < height-1) light_queue.push_back(cell + width);
+    }
+}
+
+float LightGrid::level(int x, int y) const {
+    if (x < 0 || x >= width || y < 0 || y >= height) return 0.0f;
+    return levels[y*width + x] / (float)max_light_level;
+}
+
+glm::vec3 LightGrid::faceLight(const Map& map, const RayHit& hit) const {
+    if (hit.cell < 0 || map.width != width || map.height != height) return glm::vec3(0.0f);
+    int x = hit.cell % width;
+    int y = hit.cell / width;
+    // block faces are lit from the cell they face, shapes stand in their own light
+    if (opaque(map, hit.cell)) {
+        x += face_normal_x[hit.side];
+        y += face_normal_y[hit.side];
+    }
+    if (x < 0 || x >= width || y < 0 || y >= height) return glm::vec3(0.0f);
+    float here = levels[y*width + x];
+    // halfway between this cell's middle and the next one's along the face the two mix
+    // evenly, unless the next one is a wall
+    int ax = hit.side == 0 || hit.side == 2 ? 0 : 1;
+    int ay = 1 - ax;
+    int step = hit.face_u < 0.5f ? -1 : 1;
+    int nx = x + ax*step;
+    int ny = y + ay*step;
+    float there = here;
+    if (nx >= 0 && nx < width && ny >= 0 && ny < height && !opaque(map, ny*width + nx)) there = levels[ny*width + nx];
+    float level = glm::mix(here, there, std::fabs(hit.face_u - 0.5f));
+    return colour * (level / max_light_level);
+}
@@ -0,0 +1,88 @@
+#include "../include/lightmap.h"
+#include "../include/assets.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace {
+
+const char lightmap_magic[4] = {'R', 'C', 'L', 'M'};
+const int32_t lightmap_version = 1;
+
+struct LightmapHeader {
+    char magic[4];
+    int32_t version;
+    int32_t width;
+    int32_t height;
+    int32_t samples;
+    int32_t slots;
+};
+
+struct SlotHeader {
+    int32_t cell;
+    int32_t side;
+};
+
+}
+
+bool saveLightmap(const std::string& path, int width, int height, const Lightmap& lightmap) {
+    // write to a temporary first so a crash never leaves a truncated lightmap behind
+    std::string tmp_path = path + ".tmp";
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!file) return false;
+
+    int slots = lightmap.samples > 0 ? lightmap.rgb.size() / (lightmap.samples*3) : 0;
+    LightmapHeader header = {};
+    std::memcpy(header.magic, lightmap_magic, sizeof(lightmap_magic));
+    header.version = lightmap_version;
+    header.width = width;
+    header.height = height;
+    header.samples = lightmap.samples;
+    header.slots = slots;
+    file.write((const char*)&header, sizeof(header));
+
+    // the slot table on disk is the other way round, slot to face
+    std::vector<SlotHeader> faces(slots, SlotHeader{-1, 0});
+    for (size_t i=0; i<lightmap.face_slot.size(); i++) {
+        if (lightmap.face_slot[i] >= 0) faces[lightmap.face_slot[i]] = {(int32_t)(i/4), (int32_t)(i%4)};
+    }
+    for (int slot=0; slot<slots; slot++) {
+        file.write((const char*)&faces[slot], sizeof(SlotHeader));
+        file.write((const char*)&lightmap.rgb[slot*lightmap.samples*3], lightmap.samples*3);
+    }
+    file.close();
+    if (!file) return false;
+    std::error_code ec;
+    std::filesystem::rename(tmp_path, path, ec);
+    return !ec;
+}
+
+bool loadLightmap(const std::string& path, int width, int height, Lightmap& lightmap) {
+    lightmap = Lightmap();
+    Asset file;
+    if (!loadAsset(path, file) || file.size < sizeof(LightmapHeader)) return false;
+    LightmapHeader header;
+    std::memcpy(&header, file.data, sizeof(header));
+    if (std::memcmp(header.magic, lightmap_magic, sizeof(lightmap_magic)) != 0 || header.version != lightmap_version ||
+        header.width != width || header.height != height || header.samples <= 0 || header.slots < 0) {
+        return false;
+    }
+    size_t record = sizeof(SlotHeader) + header.samples*3;
+    if (file.size != sizeof(header) + record*header.slots) return false;
+
+    Lightmap loaded;
+    loaded.samples = header.samples;
+    loaded.face_slot.assign((size_t)width*height*4, -1);
+    loaded.rgb.resize((size_t)header.slots*header.samples*3);
+    const unsigned char* at = file.data + sizeof(header);
+    for (int slot=0; slot<header.slots; slot++, at += record) {
+        SlotHeader face;
+        std::memcpy(&face, at, sizeof(face));
+        if (face.cell < 0 || face.cell >= width*height || face.side < 0 || face.side > 3) return false;
+        loaded.face_slot[face.cell*4 + face.side] = slot;
+        std::memcpy(&loaded.rgb[(size_t)slot*header.samples*3], at + sizeof(face), header.samples*3);
+    }
+    lightmap = std::move(loaded);
+    return true;
+}
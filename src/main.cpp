@@ -2,22 +2,66 @@
 #include <iostream>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
+#include <array>
+#include <chrono>
 #include <cmath>
+#include <fstream>
+#include <string>
 #include "../include/shader.h"
+#include "../include/camera.h"
+#include "../include/map.h"
+#include "../include/map_edits.h"
+#include "../include/light_grid.h"
+#include "../include/moving_blocks.h"
+#include "../include/portals.h"
+#include "../include/raycast.h"
+#include "../include/security_cameras.h"
+#include "../include/gpu_timer.h"
+#include "../include/software_render.h"
+#include "../include/sprites.h"
+#include "../include/texture_feedback.h"
+#include "../include/column_hiz.h"
+#include "../include/texture_compress.h"
+#include "../include/virtual_texture.h"
 #include "../include/glm/glm.hpp"
 #include "../include/glm/gtc/matrix_transform.hpp"
 #include "../include/glm/gtc/type_ptr.hpp"
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
-#include <json.hpp>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow *window);
-void castRay(glm::vec2 start_pos, glm::vec2 ray_dir, int* grid, int grid_sx, int grid_sy, float* pDist, float* tex_x, int* tex_index);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 bool isColour(float* col_1, float* col_2);
 void setColour(float* col, float r, float g, float b);
-//void loadJSON(const char* path, );
+void applyMap();
+int runHeadless(int frames, const std::string& map_name);
+int runBenchmarks(const std::string& map_name);
+void benchmarkEdits(const Map& source);
+void benchmarkLights(const Map& source);
+void benchmarkViewDistance(const Map& source);
+void benchmarkShapes(const Map& source);
+void benchmarkLayers(const Map& source);
+void tileMap(const Map& source, int size, Map& big);
+void randomRays(const Map& map, int count, std::vector<glm::vec2>& pos, std::vector<glm::vec2>& dir);
+
+// A manifest's material lists, each filled out to one entry per material, for the
+// benchmarks to add materials to after the map's own
+struct MaterialLists {
+    std::vector<int> tex_sides;
+    std::vector<uint8_t> flags;
+    std::vector<float> heights;
+    std::vector<uint8_t> shapes;
+    std::vector<float> params;
+
+    explicit MaterialLists(const MapManifest& manifest);
+    int count() const { return tex_sides.size()/4; }
+    // returns the new material's index
+    int add(std::array<int, 4> sides, uint8_t flag, float height, uint8_t shape, float param);
+    void build(int cell_count, MaterialTable& table) const {
+        buildMaterialTable(tex_sides, flags, heights, shapes, params, cell_count, table);
+    }
+};
 
 class Player {
     public:
@@ -63,13 +107,6 @@ float rect[] = {
      1.0f,-1.0f, 0.0f
 };
 
-int tex_sides[] = {
-    0, 0, 0, 0,
-    1, 1, 1, 1,
-    2, 2, 2, 2,
-    0, 1, 2, 3
-};
-
 /*int map[] = {
     1, 1, 1, 1, 1, 1, 1,
     1, 1, 0, 0, 0, 0, 1,
@@ -81,9 +118,27 @@ int tex_sides[] = {
 };
 int map_x = 7;
 int map_y = 7;*/
-int map_x, map_y;
 float wall_height = 4.0f;
-std::string cur_map = "map1";
+Map world;
+MapStreamer map_streamer;
+MapEditor map_editor;
+const int build_cell = 4;           // what Q puts up, material 1
+const float pushwall_speed = 1.0f;  // cells per second
+const int pushwall_cells = 2;
+std::vector<CellEdit> moved_cells;  // cells moving blocks took or let go of this frame
+LightGrid light_grid;
+bool torch_on = false;
+int torch_light = -1;
+int flash_light = -1;
+float flash_time = 0.0f;
+const int torch_level = 8;          // max_light_level is 15
+const int flash_level = 13;
+const float flash_length = 0.08f;   // seconds
+const int light_budget = 20000;     // cells LightGrid::update may do per frame
+const int mirror_rays = 2048;       // reflected rays per frame, over all the columns
+const int mirror_bounces = 3;
+SecurityCameras security_cameras;
+const int camera_refreshes = 2;     // security camera views redrawn per frame
 
 Player player(scr_rat, glm::vec2(2.5f, 3.45f), glm::radians(0.0f), 30.0f, wall_height);
 float player_speed = wall_height;
@@ -95,9 +150,24 @@ float window_resize_time = -1.0f;
 int resize_x, resize_y;
 float t;
 float dt;
+bool show_timings = false;
+bool timings_key_down = false;
+bool remove_key_down = false;
+bool build_key_down = false;
+bool use_key_down = false;
+bool torch_key_down = false;
+bool flash_key_down = false;
 
-int main() {
+int main(int argc, char** argv) {
     std::cout << title << "\n";
+    // --headless [frames] [map]: CPU renderer only, no window or GL context
+    if (argc > 1 && std::string(argv[1]) == "--headless") {
+        return runHeadless(argc > 2 ? std::max(1, std::atoi(argv[2])) : 100, argc > 3 ? argv[3] : "map1");
+    }
+    // --bench [map]: the edit, light grid and ray benchmarks on big maps built from one
+    if (argc > 1 && std::string(argv[1]) == "--bench") {
+        return runBenchmarks(argc > 2 ? argv[2] : "map1");
+    }
 
     // init glfw
     glfwInit();
@@ -121,6 +191,7 @@ int main() {
         std::cout << "GLAD initialisation failed.\n";
         return 0;
     }
+    detectCompressionSupport();
     
     // settings
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
@@ -135,26 +206,65 @@ int main() {
     Shader mapShader("src/shaders/vMapShader.glsl", "src/shaders/fShader.glsl");
     Shader mapPlayerShader("src/shaders/vMapPlayerShader.glsl", "src/shaders/fShader.glsl");
     Shader columnShader("src/shaders/vColumnShader.glsl", "src/shaders/fShader2.glsl");
+    Shader floorShader("src/shaders/vFloorShader.glsl", "src/shaders/fFloorShader.glsl");
+    Shader spriteShader("src/shaders/vSpriteShader.glsl", "src/shaders/fSpriteShader.glsl");
+    Shader skyShader("src/shaders/vSkyShader.glsl", "src/shaders/fSkyShader.glsl");
+    CameraBuffer camera;
+    camera.create();
+    int column_colour_loc = columnShader.location("aColour");
+    int column_virtual_loc = columnShader.location("virtualTexturing");
+    int map_size_loc = floorShader.location("mapSize");
+    int floor_virtual_loc = floorShader.location("virtualTexturing");
+    int sprite_virtual_loc = spriteShader.location("virtualTexturing");
+    int sky_virtual_loc = skyShader.location("virtualTexturing");
+    int sky_texture_loc = skyShader.location("skyTexture");
+    int sky_repeats_loc = skyShader.location("skyRepeats");
+    int view_angle_loc = skyShader.location("viewAngle");
+    SpriteRenderer sprites;
+    sprites.create();
+    security_cameras.create();
+    columnShader.use();
+    columnShader.setInt("cameraViews", 1);
+
+    // per pass cost, summed until it is printed (F1)
+    GpuTimer wall_timer, floor_timer, sky_timer, sprite_timer, camera_timer;
+    wall_timer.create();
+    floor_timer.create();
+    sky_timer.create();
+    sprite_timer.create();
+    camera_timer.create();
+    double rays_ms = 0.0, walls_ms = 0.0, floors_ms = 0.0, sky_ms = 0.0, sprites_ms = 0.0, sprites_cpu_ms = 0.0,
+           cameras_ms = 0.0;
+    int timed_frames = 0;
+    float timings_printed = 0.0f;
     
     // collumn vertices
-    // pos, wall type, texture_pos
-    int lines_stride = 6;
-    float lines[fbx*lines_stride*2];
-    //std::cout << sizeof(lines)/sizeof(float) << "\n";
-    for (int i = 0; i < fbx; i++) {
-        lines[i*lines_stride*2+0] = ((float)i / fbx) * 2 - 1;
-        lines[i*lines_stride*2+1] = 0.5f;
-        lines[i*lines_stride*2+2] = 1.0f;
-        lines[i*lines_stride*2+3] = 0.0f;
-        lines[i*lines_stride*2+4] = ((float)i / fbx) * 2 - 1;
-        lines[i*lines_stride*2+5] = 1.0f;
-        lines[i*lines_stride*2+6] = ((float)i / fbx) * 2 - 1;
-        lines[i*lines_stride*2+7] = 0.5f;
-        lines[i*lines_stride*2+8] = 1.0f;
-        lines[i*lines_stride*2+9] = 0.0f;
-        lines[i*lines_stride*2+10] = ((float)i / fbx) * 2 - 1;
-        lines[i*lines_stride*2+11] = 0.0f;
-    }
+    // pos, wall type, texture_pos, light
+    int lines_stride = 9;
+    // a line per visible wall span, as many per column as castSpans finds. The span
+    // lists are per frame arenas for castSpans, everything here is cleared every frame
+    // and never shrunk.
+    std::vector<WallSpan> wall_spans;
+    std::vector<WallSpan> clear_spans;          // see-through cells
+    std::vector<float> lines;
+    std::vector<float> layer_lines;             // clear_spans far to near per column
+    size_t lines_capacity = 0;
+    size_t layer_capacity = 0;
+    double spans_drawn = 0.0;
+    // view depth at which each column got covered, what the sprites test against
+    std::vector<float> column_depth(fbx);
+    // first span and span count in wall_spans per column, -1 spans when it can't be
+    // interpolated from
+    std::vector<glm::ivec2> column_spans(fbx);
+    double columns_interpolated = 0.0;
+    // angle of every column's ray from the view direction for the sky pass, only rebuilt
+    // when the field of view or the width changes
+    std::vector<float> sky_angles;
+    float sky_fov = 0.0f;
+    unsigned int sky_buffer;
+    glGenBuffers(1, &sky_buffer);
+    double mirror_rays_cast = 0.0;
+    ColumnHiZ column_hiz;
     
     // create lines vbo, vao
     unsigned int linesVBO, linesVAO;
@@ -162,14 +272,30 @@ int main() {
     glGenBuffers(1, &linesVBO);
     glBindVertexArray(linesVAO);
     glBindBuffer(GL_ARRAY_BUFFER, linesVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(lines), lines, GL_DYNAMIC_DRAW);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, lines_stride*sizeof(float), (void*)0);  // pos
     glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, lines_stride*sizeof(float), (void*)(3*sizeof(float)));  // wall type
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, lines_stride*sizeof(float), (void*)(4*sizeof(float)));  // texture coord
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, lines_stride*sizeof(float), (void*)(6*sizeof(float)));  // light
     glEnableVertexAttribArray(0);
     glEnableVertexAttribArray(1);
     glEnableVertexAttribArray(2);
+    glEnableVertexAttribArray(3);
     glBindVertexArray(linesVAO);
+
+    // see-through layers, same layout as the column lines
+    unsigned int layersVBO, layersVAO;
+    glGenVertexArrays(1, &layersVAO);
+    glGenBuffers(1, &layersVBO);
+    glBindVertexArray(layersVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, layersVBO);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, lines_stride*sizeof(float), (void*)0);
+    glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, lines_stride*sizeof(float), (void*)(3*sizeof(float)));
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, lines_stride*sizeof(float), (void*)(4*sizeof(float)));
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, lines_stride*sizeof(float), (void*)(6*sizeof(float)));
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);
+    glEnableVertexAttribArray(3);
     
     // create rect vbo, vao
     unsigned int rectVBO, rectVAO;
@@ -184,45 +310,20 @@ int main() {
     
     // map loading
     //stbi_set_flip_vertically_on_load();
-    int width, height, nrChannels;
-    std::string map_path = "maps/" + cur_map + "/walls.png";
-    unsigned char *data = stbi_load(map_path.c_str(), &width, &height, &nrChannels, 0);
-    std::cout << nrChannels << "\n";
-    if (!data) std::cout << "Map did not load.\n";
-    map_x = width;
-    map_y = height;
-    int map[width * height];
-    for (int i=0; i<width*height; i++) {
-        int r = data[i*nrChannels+0]+1;   // Greater digit
-        int g = data[i*nrChannels+1]+1;   // Lesser digit
-        int b = data[i*nrChannels+2]+1;   // Rotation
-        map[i] = r/4 + g/16 + b/64;
-    }
-    std::cout << map_x << "\n";
-    std::cout << map_y << "\n";
-
-    for (int y=0; y<map_y; y++) {
-        for (int x=0; x<map_x; x++) {
-            std::cout << map[y*map_y + x] << " ";
+    if (!loadMap("map1", world)) std::cout << "Map did not load.\n";
+    std::cout << world.width << "\n";
+    std::cout << world.height << "\n";
+
+    for (int y=0; y<world.height; y++) {
+        for (int x=0; x<world.width; x++) {
+            std::cout << world.grid[y*world.width + x] << " ";
         }
         std::cout << "\n";
     }
-
-    // texture loading
-    std::string atlas_path = "maps/" + cur_map + "/walls_atlas.png";
-    data = stbi_load(atlas_path.c_str(), &width, &height, &nrChannels, 0);
-    if (!data) std::cout << "Texture did not load.\n";
-    unsigned int texture;
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-    stbi_image_free(data);
-    // parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    uploadMap(world);
+    applyMap();
+    security_cameras.reset(world);
+    map_editor.addListener(&light_grid);
 
     float prev_t = 0.0f;
     
@@ -239,66 +340,305 @@ int main() {
             fby = resize_y;
             glViewport(0, 0, fbx, fby);*/
         }
+        // map switches only ever land here, between two frames
+        if (map_streamer.update(world)) {
+            map_editor.clear();
+            applyMap();
+            security_cameras.reset(world);
+        }
+        glm::vec2 last_pos = player.pos;
         processInput(window);
+        // walking into a portal face comes out of its exit face, turned the same as the rays
+        float ang = player.ang;
+        if (crossPortal(world, last_pos, player.pos, ang)) player.setAng(ang);
+        // edits made since the last frame all land here, before any rays are cast
+        map_editor.apply(world);
+        updateMovingBlocks(world, dt, &moved_cells);
+        map_editor.notify(world, moved_cells);
+        moved_cells.clear();
+        // the torch follows the player, a flash only lasts a few frames
+        light_grid.moveLight(torch_light, player.pos);
+        if (flash_light >= 0 && t - flash_time > flash_length) {
+            light_grid.removeLight(flash_light);
+            flash_light = -1;
+        }
+        light_grid.update(world, light_budget);
         //std::cout << "(" << player.pos.x << ", " << player.pos.y << ") " << player.ang << "\n";
         
-        glClearColor(0.0, 0.0f, 0.2f, 1.0f);
+        // the clear colour is what shows past the view distance, so it is the fog's
+        const glm::vec3& fog_colour = world.manifest.fog_colour;
+        glClearColor(fog_colour.r, fog_colour.g, fog_colour.b, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         
         /*
         mapShader.use();
         glm::vec3 colour;
+        int scale_loc = mapShader.location("scale");
+        int pos_loc = mapShader.location("pos");
+        int colour_loc = mapShader.location("colour");
         for (int y=0; y<map_length; y++) {
             for (int x=0; x<map_length; x++) {
                 int value = map[y*map_length + x];
                 if (value == 0) colour = glm::vec3(0.0f, 0.0f, 0.0f);
                 if (value == 1) colour = glm::vec3(1.0f, 0.0f, 1.0f);
                 float scale = 1.0f/(float)map_length;
-                mapShader.setFloat("scale", scale);
-                mapShader.setVec2("pos", glm::vec2((float)x, (float)y));
-                mapShader.setVec3("colour", colour);
+                mapShader.setFloat(scale_loc, scale);
+                mapShader.setVec2(pos_loc, glm::vec2((float)x, (float)y));
+                mapShader.setVec3(colour_loc, colour);
                 glBindVertexArray(rectVAO);
                 glDrawArrays(GL_TRIANGLES, 0, 6);
             }
         }
         */
         
-        for (int i=0; i<fbx; i++) {
-            float ray_ang;
-            float ray_dist;
-            int wall_type;
-            float tex_x;
-            float ratio = ((float)i/(float)fbx)*2-1;
-            glm::vec2 player_dir = player.ang_dir;
-            glm::vec2 plane = {-player_dir.y, player_dir.x};
-            plane *= tan(player.fov/2.0f);
-            float camera_x = 2.0f * i / float(fbx) - 1.0f;
-            glm::vec2 ray_dir = player_dir + plane * camera_x;
-            ray_dir = glm::normalize(ray_dir);
-            castRay(player.pos, ray_dir, map, map_x, map_y, &ray_dist, &tex_x, &wall_type);
-            float corrected_dist = dot(ray_dir, player_dir) * ray_dist;
-            float proj_scale = 1.0f/(2*tan(player.vfov/2.0f));
-            lines[i*lines_stride*2+0] = ratio;
-            lines[i*lines_stride*2+1] = (wall_height)/corrected_dist*proj_scale;
-            lines[i*lines_stride*2+2] = ray_dist;
-            lines[i*lines_stride*2+3] = (float)tex_sides[wall_type];
-            lines[i*lines_stride*2+4] = tex_x/wall_height;
-            // number 5 is tex_y, not changed
-            lines[i*lines_stride*2+6] = ratio;
-            lines[i*lines_stride*2+7] = 0-(wall_height)/corrected_dist*proj_scale;
-            lines[i*lines_stride*2+8] = ray_dist;
-            lines[i*lines_stride*2+9] = (float)tex_sides[wall_type];
-            lines[i*lines_stride*2+10] = tex_x/wall_height;
-            // number 11 is tex_y, not changed
+        glm::vec2 player_dir = player.ang_dir;
+        glm::vec2 plane = {-player_dir.y, player_dir.x};
+        plane *= tan(player.fov/2.0f);
+        float proj_scale = 1.0f/(2*tan(player.vfov/2.0f));
+        CameraUniforms camera_uniforms;
+        camera_uniforms.pos_dir = glm::vec4(player.pos, player_dir);
+        camera_uniforms.plane = glm::vec4(plane, player.eye_lev, wall_height);
+        camera_uniforms.screen = glm::vec4(fbx, fby, proj_scale, t);
+        camera_uniforms.fog = glm::vec4(fog_colour, world.manifest.fogDensity());
+        camera_uniforms.view = glm::vec4(world.manifest.maxDist(), world.manifest.fog_start, world.manifest.lod_distance, 0.0f);
+        camera.update(camera_uniforms);
+
+        // two vertices per span, vColumnShader scales y by the projected wall height
+        auto pushSpan = [&](std::vector<float>& out, const WallSpan& span, float x, float view_cos) {
+            const RayHit& hit = span.hit;
+            // the shader does this projection itself, it's only needed here for the
+            // feedback and the monitors' coverage
+            float line_y = wall_height/(hit.dist*view_cos)*std::abs(proj_scale);
+            int monitor = security_cameras.cameraOf(world, span);
+            if (monitor >= 0) {
+                // a screen lights itself, and shows the view once across the face,
+                // left to right whichever face it is
+                float u = hit.side == 0 || hit.side == 1 ? hit.face_u : 1.0f - hit.face_u;
+                float top[] = {x, span.top, hit.dist, -1.0f - monitor, u, span.v_top, 1.0f, 1.0f, 1.0f};
+                float bottom[] = {x, span.bottom, hit.dist, -1.0f - monitor, u, span.v_bottom, 1.0f, 1.0f, 1.0f};
+                out.insert(out.end(), top, top + lines_stride);
+                out.insert(out.end(), bottom, bottom + lines_stride);
+                security_cameras.addCoverage(monitor, (span.top - span.bottom)*line_y*fby*0.5f);
+                return;
+            }
+            // one lightmap and one light grid lookup per span, the whole span gets the same
+            // light. Emissive faces light themselves like the monitors.
+            glm::vec3 light(1.0f);
+            if (!(hit.flags & MAT_EMISSIVE)) {
+                light = world.lightmap.sample(hit.cell, hit.side, hit.face_u, glm::vec3(world.manifest.ambient));
+                light += light_grid.faceLight(world, hit);
+            }
+            float top[] = {x, span.top, hit.dist, (float)hit.tex, hit.tex_x/wall_height, span.v_top,
+                           light.r, light.g, light.b};
+            float bottom[] = {x, span.bottom, hit.dist, (float)hit.tex, hit.tex_x/wall_height, span.v_bottom,
+                              light.r, light.g, light.b};
+            out.insert(out.end(), top, top + lines_stride);
+            out.insert(out.end(), bottom, bottom + lines_stride);
+            if (world.virtual_texture && span.v_top > span.v_bottom) {
+                // far spans ask for the smaller mips the shader's lod bias will use
+                float span_pixels = (span.top - span.bottom)*line_y*fby*0.5f / std::exp2(world.manifest.lodBias(hit.dist));
+                // texture rows run top down, v bottom up
+                world.virtual_texture->request(hit.tex, hit.tex_x/wall_height, 1.0f - span.v_top, 1.0f - span.v_bottom,
+                                               span_pixels/(span.v_top - span.v_bottom));
+            }
+        };
+
+        auto rays_start = std::chrono::steady_clock::now();
+        wall_spans.clear();
+        clear_spans.clear();
+        lines.clear();
+        layer_lines.clear();
+        SpanBudget budget;
+        budget.see_through = world.manifest.transparent_hits;
+        budget.max_dist = world.manifest.maxDist();
+        ReflectionBudget reflections;
+        reflections.rays = mirror_rays;
+        reflections.bounces = mirror_bounces;
+        // even columns first, then the odd ones, which take the average of the two either
+        // side when those are far off on the same face (see interpolateSpan). Lines can go
+        // in any column order, the columns never overlap.
+        for (int pass=0; pass<2; pass++) {
+            for (int i=pass; i<fbx; i+=2) {
+                float ratio = ((float)i/(float)fbx)*2-1;
+                float camera_x = 2.0f * i / float(fbx) - 1.0f;
+                glm::vec2 ray_dir = player_dir + plane * camera_x;
+                ray_dir = glm::normalize(ray_dir);
+                float view_cos = dot(ray_dir, player_dir);
+                size_t first_span = wall_spans.size();
+                size_t first_clear = clear_spans.size();
+                bool covered = true;
+                WallSpan between;
+                const glm::ivec2* left = pass == 1 ? &column_spans[i-1] : nullptr;
+                const glm::ivec2* right = pass == 1 && i+1 < fbx ? &column_spans[i+1] : nullptr;
+                if (left && right && left->y == 1 && right->y == 1 &&
+                    interpolateSpan(world, wall_spans[left->x], wall_spans[right->x], world.manifest.lod_distance, between)) {
+                    wall_spans.push_back(between);
+                    column_depth[i] = (column_depth[i-1] + column_depth[i+1])*0.5f;
+                    columns_interpolated++;
+                }
+                else {
+                    covered = castSpans(world, player.pos, ray_dir, view_cos, proj_scale, budget, wall_spans, clear_spans,
+                                        column_depth[i]);
+                    reflectSpans(world, wall_spans, first_span, budget.max_dist, reflections);
+                }
+                // only covered columns without see-through spans can stand in for their neighbours
+                int count = wall_spans.size() - first_span;
+                column_spans[i] = glm::ivec2(first_span, covered && clear_spans.size() == first_clear ? count : -1);
+                for (size_t s=first_span; s<wall_spans.size(); s++) pushSpan(lines, wall_spans[s], ratio, view_cos);
+                // far to near, columns never overlap so that is all the ordering blending needs
+                for (size_t s=clear_spans.size(); s-- > first_clear;) pushSpan(layer_lines, clear_spans[s], ratio, view_cos);
+            }
+        }
+        spans_drawn += wall_spans.size();
+        mirror_rays_cast += reflections.used;
+        column_hiz.build(column_depth);
+        rays_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - rays_start).count();
+        // culled here rather than with the draw, so the virtual texture hears about the
+        // sprites' pages before the wall pass uploads this frame's
+        sprites.cull(world.sprites, player.pos, player_dir, plane, &column_hiz);
+        sprites_cpu_ms += sprites.stats.cull_ms + sprites.stats.sort_ms;
+        if (world.virtual_texture) {
+            SoftwareView view = {player.pos, player_dir, plane, proj_scale};
+            requestFloorPages(world, *world.virtual_texture, view, fbx, fby, column_depth);
+            requestSpritePages(world, *world.virtual_texture, view, fbx, fby, sprites.visible);
+            requestSkyPages(world, *world.virtual_texture, player.ang, player.fov, fbx, fby);
         }
         
+        wall_timer.begin();
         columnShader.use();
         glm::vec3 colour(1.0f, 1.0f, 1.0f);
-        columnShader.setVec3("aColour", colour);
+        columnShader.setVec3(column_colour_loc, colour);
+        columnShader.setBool(column_virtual_loc, world.virtual_texture != nullptr);
+        if (world.virtual_texture) {
+            world.virtual_texture->update();
+            world.virtual_texture->bind();
+        }
+        else glBindTexture(GL_TEXTURE_2D_ARRAY, world.atlas_texture);
+        security_cameras.bind(1);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, world.rects_buffer);
         glBindBuffer(GL_ARRAY_BUFFER, linesVBO);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(lines), lines);
+        if (lines.size() > lines_capacity) {
+            lines_capacity = lines.size() * 2;
+            glBufferData(GL_ARRAY_BUFFER, lines_capacity*sizeof(float), NULL, GL_DYNAMIC_DRAW);
+        }
+        glBufferSubData(GL_ARRAY_BUFFER, 0, lines.size()*sizeof(float), lines.data());
         glBindVertexArray(linesVAO);
-        glDrawArrays(GL_LINES, 0, fbx*2);
+        glDrawArrays(GL_LINES, 0, lines.size()/lines_stride);
+        wall_timer.end();
+
+        // floors and ceilings after the walls, the depth test leaves only the pixels the
+        // columns didn't cover to be shaded
+        floor_timer.begin();
+        floorShader.use();
+        floorShader.setBool(floor_virtual_loc, world.virtual_texture != nullptr);
+        glUniform2i(map_size_loc, world.width, world.height);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, world.floor_buffer);
+        glDepthFunc(GL_LEQUAL);
+        glBindVertexArray(rectVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+        floor_timer.end();
+
+        // the sky last of the three, on the pixels above the horizon neither a wall nor a
+        // ceiling took
+        sky_timer.begin();
+        if (world.manifest.sky_texture >= 0) {
+            if ((int)sky_angles.size() != fbx || sky_fov != player.fov) {
+                sky_angles.resize(fbx);
+                float half_width = tan(player.fov/2.0f);
+                for (int i=0; i<fbx; i++) sky_angles[i] = std::atan((2.0f * i / float(fbx) - 1.0f) * half_width);
+                sky_fov = player.fov;
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, sky_buffer);
+                glBufferData(GL_SHADER_STORAGE_BUFFER, sky_angles.size()*sizeof(float), sky_angles.data(), GL_STATIC_DRAW);
+            }
+            skyShader.use();
+            skyShader.setBool(sky_virtual_loc, world.virtual_texture != nullptr);
+            skyShader.setInt(sky_texture_loc, world.manifest.sky_texture);
+            skyShader.setFloat(sky_repeats_loc, world.manifest.sky_repeats);
+            skyShader.setFloat(view_angle_loc, player.ang);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, sky_buffer);
+            glDepthMask(GL_FALSE);
+            glBindVertexArray(rectVAO);
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+            glDepthMask(GL_TRUE);
+        }
+        glDepthFunc(GL_LESS);
+        sky_timer.end();
+
+        // sprites far to near, hidden by the walls that cover their columns in the shader
+        // and by lower walls in front of them through the depth test
+        sprite_timer.begin();
+        spriteShader.use();
+        spriteShader.setBool(sprite_virtual_loc, world.virtual_texture != nullptr);
+        sprites.setColumnDepth(column_depth);
+        sprites.draw();
+        sprite_timer.end();
+
+        // see-through cells last, blended by their texture's alpha
+        if (!layer_lines.empty()) {
+            columnShader.use();
+            glBindBuffer(GL_ARRAY_BUFFER, layersVBO);
+            if (layer_lines.size() > layer_capacity) {
+                layer_capacity = layer_lines.size() * 2;
+                glBufferData(GL_ARRAY_BUFFER, layer_capacity*sizeof(float), NULL, GL_STREAM_DRAW);
+            }
+            glBufferSubData(GL_ARRAY_BUFFER, 0, layer_lines.size()*sizeof(float), layer_lines.data());
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+            glDepthMask(GL_FALSE);
+            glBindVertexArray(layersVAO);
+            glDrawArrays(GL_LINES, 0, layer_lines.size()/lines_stride);
+            glDepthMask(GL_TRUE);
+            glDisable(GL_BLEND);
+        }
+
+        // the monitors seen this frame are drawn from next frame on, out of the views
+        // of whichever cameras the coverage above picked
+        camera_timer.begin();
+        if (security_cameras.refresh(world, light_grid, columnShader, floorShader, camera, t, camera_refreshes) > 0) {
+            glViewport(0, 0, fbx, fby);
+        }
+        camera_timer.end();
+
+        walls_ms += wall_timer.last_ms;
+        floors_ms += floor_timer.last_ms;
+        sky_ms += sky_timer.last_ms;
+        sprites_ms += sprite_timer.last_ms;
+        cameras_ms += camera_timer.last_ms;
+        timed_frames++;
+        if (t - timings_printed >= 1.0f) {
+            if (show_timings) {
+                std::cout << "frame " << 1000.0*dt << " ms: rays " << rays_ms/timed_frames << " ms (cpu, "
+                          << spans_drawn/timed_frames/fbx << " spans per column), walls "
+                          << walls_ms/timed_frames << " ms, floors " << floors_ms/timed_frames << " ms, sky "
+                          << sky_ms/timed_frames << " ms, sprites "
+                          << sprites_ms/timed_frames << " ms (gpu) + " << sprites_cpu_ms/timed_frames << " ms cull/sort, "
+                          << sprites.stats.visible << "/" << sprites.stats.total << " sprites visible ("
+                          << sprites.stats.occluded << " behind walls), " << clear_spans.size() << " see-through spans, "
+                          << columns_interpolated/timed_frames << " columns interpolated, "
+                          << mirror_rays_cast/timed_frames << " mirror rays";
+                if (map_editor.timing.batches > 0) {
+                    std::cout << ", " << map_editor.timing.cells << " cells edited in " << map_editor.timing.batches
+                              << " batches (" << map_editor.timing.apply_ms << " ms, listeners "
+                              << map_editor.timing.listeners_ms << " ms)";
+                }
+                if (security_cameras.timing.refreshes > 0) {
+                    std::cout << ", " << security_cameras.timing.refreshes << " camera views redrawn over "
+                              << timed_frames << " frames (" << security_cameras.timing.ms/timed_frames
+                              << " ms cpu, " << cameras_ms/timed_frames << " ms gpu per frame)";
+                }
+                if (light_grid.timing.updates > 0) {
+                    std::cout << ", " << light_grid.lightCount() << " dynamic lights relit "
+                              << light_grid.timing.cells << " cells in " << light_grid.timing.ms << " ms";
+                }
+                std::cout << "\n";
+            }
+            map_editor.timing = EditTiming();
+            light_grid.timing = LightTiming();
+            security_cameras.timing = CameraTiming();
+            rays_ms = walls_ms = floors_ms = sky_ms = sprites_ms = sprites_cpu_ms = cameras_ms = spans_drawn = columns_interpolated = mirror_rays_cast = 0.0;
+            timed_frames = 0;
+            timings_printed = t;
+        }
         
         glfwSwapBuffers(window);
         glfwPollEvents();
@@ -307,12 +647,409 @@ int main() {
     glDeleteBuffers(1, &rectVBO);
     glDeleteVertexArrays(1, &linesVAO);
     glDeleteBuffers(1, &linesVBO);
+    glDeleteVertexArrays(1, &layersVAO);
+    glDeleteBuffers(1, &layersVBO);
     mapShader.del();
     columnShader.del();
+    floorShader.del();
+    spriteShader.del();
+    skyShader.del();
+    glDeleteBuffers(1, &sky_buffer);
+    sprites.release();
+    wall_timer.del();
+    floor_timer.del();
+    sky_timer.del();
+    sprite_timer.del();
+    camera_timer.del();
+    security_cameras.release();
+    camera.del();
+    releaseMap(world);
 
     glfwTerminate();
     return 0;
 }
+
+// per-map settings from the manifest, after the initial load and after every map switch
+void applyMap() {
+    wall_height = world.manifest.wall_height;
+    player_speed = wall_height;
+    player.eye_lev = 0.75f*wall_height;
+    player.pos = world.manifest.spawn_pos;
+    player.setAng(world.manifest.spawn_ang);
+    // lights belong to the map they were lit in
+    light_grid.reset(world);
+    torch_light = torch_on ? light_grid.addLight(player.pos, torch_level) : -1;
+    flash_light = -1;
+}
+
+// Renders the spawn view of a map with the CPU floor and wall casters, turning a little
+// every frame, prints where the time went and writes the last frame to frame.ppm
+int runHeadless(int frames, const std::string& map_name) {
+    if (!loadMap(map_name, world)) {
+        std::cout << "Map did not load.\n";
+        return -1;
+    }
+    applyMap();
+    // a torch where the player stands, to see the light grid in frame.ppm
+    torch_light = light_grid.addLight(player.pos, torch_level);
+    light_grid.update(world);
+    SoftwareFrame frame;
+    frame.resize(scr_x, scr_y);
+    FloorTiming floor_timing;
+    double walls_ms = 0.0;
+    long spans = 0;
+    for (int f=0; f<frames; f++) {
+        player.setAng(world.manifest.spawn_ang + f*0.01f);
+        updateMovingBlocks(world, 1.0f/60.0f);
+        SoftwareView view;
+        view.pos = player.pos;
+        view.dir = player.ang_dir;
+        view.plane = glm::vec2(-player.ang_dir.y, player.ang_dir.x) * (float)tan(player.fov/2.0f);
+        view.proj_scale = 1.0f/(2*tan(player.vfov/2.0f));
+
+        // past the view distance nothing is drawn and the fog colour shows
+        for (size_t i=0; i<frame.pixels.size(); i+=4) {
+            for (int k=0; k<3; k++) frame.pixels[i+k] = world.manifest.fog_colour[k]*255.0f;
+            frame.pixels[i+3] = 255;
+        }
+        if (!castFloorsCPU(world, view, frame, floor_timing)) {
+            std::cout << "The CPU renderer needs uncompressed, same size texture layers.\n";
+            return -1;
+        }
+        auto walls_start = std::chrono::steady_clock::now();
+        spans += castWallsCPU(world, view, frame, &light_grid);
+        walls_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - walls_start).count();
+    }
+    std::cout << frames << " frames at " << frame.width << "x" << frame.height << ", per frame: floors "
+              << (floor_timing.setup_ms + floor_timing.address_ms + floor_timing.shade_ms)/frames << " ms (setup "
+              << floor_timing.setup_ms/frames << ", addresses " << floor_timing.address_ms/frames << ", shading "
+              << floor_timing.shade_ms/frames << ", " << floor_timing.pixels/frames << " pixels), walls "
+              << walls_ms/frames << " ms (" << (double)spans/frames/frame.width << " spans per column)\n";
+
+    std::ofstream out("frame.ppm", std::ios::binary);
+    out << "P6\n" << frame.width << " " << frame.height << "\n255\n";
+    for (size_t i=0; i<frame.pixels.size(); i+=4) out.write((const char*)&frame.pixels[i], 3);
+    return 0;
+}
+
+// Each benchmark builds its own big map out of copies of map_name, nothing is drawn
+int runBenchmarks(const std::string& map_name) {
+    if (!loadMap(map_name, world)) {
+        std::cout << "Map did not load.\n";
+        return -1;
+    }
+    benchmarkEdits(world);
+    benchmarkLights(world);
+    benchmarkViewDistance(world);
+    benchmarkShapes(world);
+    benchmarkLayers(world);
+    return 0;
+}
+
+// Edit costs on a big map made of copies of source: one cell per batch, a 64x64 block
+// and every cell in one batch
+void benchmarkEdits(const Map& source) {
+    const int size = 1024;
+    Map big;
+    tileMap(source, size, big);
+
+    MapEditor editor;
+    const int singles = 1000;
+    auto start = std::chrono::steady_clock::now();
+    for (int n=0; n<singles; n++) {
+        int x = (n*7919) % size;
+        int y = (n*104729) % size;
+        editor.setCell(x, y, big.grid[y*size + x] == 0 ? build_cell : 0);
+        editor.apply(big);
+    }
+    double single_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (int y=0; y<64; y++) {
+        for (int x=0; x<64; x++) editor.setCell(480 + x, 480 + y, (x+y)%2 ? build_cell : 0);
+    }
+    editor.apply(big);
+    double block_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (int y=0; y<size; y++) {
+        for (int x=0; x<size; x++) editor.setFloor(x, y, (x+y)%2 ? 0 : build_cell);
+    }
+    editor.apply(big);
+    double full_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "edits on a " << size << "x" << size << " map: single cell " << 1000.0*single_ms/singles
+              << " us, 64x64 block " << block_ms << " ms, every floor cell " << full_ms << " ms ("
+              << editor.timing.cells << " cells changed)\n";
+}
+
+// Light grid costs on a big map made of copies of source: flooding in a few hundred
+// lights at once, then all of them wandering about for a while with the odd wall going
+// up or down in among them
+void benchmarkLights(const Map& source) {
+    const int size = 256;
+    const int light_count = 300;
+    const int frames = 300;
+    Map big;
+    tileMap(source, size, big);
+    LightGrid grid;
+    grid.reset(big);
+    MapEditor editor;
+    editor.addListener(&grid);
+
+    // start them in open cells, walking in random directions
+    std::vector<glm::vec2> pos, vel;
+    randomRays(big, light_count, pos, vel);
+    for (glm::vec2& v : vel) v *= 2.0f;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<int> ids;
+    for (glm::vec2 p : pos) ids.push_back(grid.addLight(p, torch_level));
+    long fill_cells = grid.update(big);
+    double fill_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    grid.timing = LightTiming();
+    double worst_ms = 0.0;
+    for (int f=0; f<frames; f++) {
+        for (int i=0; i<light_count; i++) {
+            glm::vec2 next = pos[i] + vel[i]/60.0f;
+            int x = (int)next.x;
+            int y = (int)next.y;
+            // bounce off walls and the map edge
+            if (next.x < 0.0f || next.y < 0.0f || x >= size || y >= size || big.grid[y*size + x] != 0) vel[i] = -vel[i];
+            else pos[i] = next;
+            grid.moveLight(ids[i], pos[i]);
+        }
+        if (f % 10 == 0) {
+            int x = (f*7919) % size;
+            int y = (f*104729) % size;
+            editor.setCell(x, y, big.grid[y*size + x] == 0 ? build_cell : 0);
+            editor.apply(big);
+        }
+        double before = grid.timing.ms;
+        grid.update(big);
+        worst_ms = std::max(worst_ms, grid.timing.ms - before);
+    }
+    std::cout << "light grid on a " << size << "x" << size << " map: " << light_count << " lights filled in "
+              << fill_ms << " ms (" << fill_cells << " cells), then " << grid.timing.ms/frames << " ms per frame ("
+              << (double)grid.timing.cells/frames << " cells, worst frame " << worst_ms << " ms) with all of them moving\n";
+}
+
+// A frame's worth of rays across a big open map with walls only round its edge, first
+// with no limit and then stopping at source's view distance
+void benchmarkViewDistance(const Map& source) {
+    const int size = 4096;
+    Map open;
+    open.manifest = source.manifest;
+    open.materials = source.materials;
+    open.wall_top = source.wall_top;
+    open.width = size;
+    open.height = size;
+    open.grid.assign(size*size, 0);
+    for (int i=0; i<size; i++) {
+        open.grid[i] = open.grid[(size-1)*size + i] = build_cell;
+        open.grid[i*size] = open.grid[i*size + size-1] = build_cell;
+    }
+    glm::vec2 pos(size*0.5f, size*0.5f);
+    glm::vec2 dir(1.0f, 0.0f);
+    glm::vec2 plane = glm::vec2(-dir.y, dir.x) * (float)tan(player.fov/2.0f);
+    float proj_scale = 1.0f/(2*tan(player.vfov/2.0f));
+    std::vector<WallSpan> spans, see_through;
+    auto frame = [&](float max_dist) {
+        SpanBudget budget;
+        budget.max_dist = max_dist;
+        spans.clear();
+        see_through.clear();
+        auto start = std::chrono::steady_clock::now();
+        for (int i=0; i<scr_x; i++) {
+            glm::vec2 ray_dir = glm::normalize(dir + plane*(2.0f*i/scr_x - 1.0f));
+            float covered_depth;
+            castSpans(open, pos, ray_dir, glm::dot(ray_dir, dir), proj_scale, budget, spans, see_through, covered_depth);
+        }
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+    double unlimited_ms = frame(1e30f);
+    double limited_ms = frame(source.manifest.maxDist());
+    std::cout << "rays across a " << size << "x" << size << " open map: " << unlimited_ms << " ms with no limit, "
+              << limited_ms << " ms stopping at " << source.manifest.view_distance << " cells\n";
+}
+
+// castRay from random open cells of a big copy of source, first on its blocks alone and
+// then with every fourth wall turned into a pillar, so the cost of the shape test shows
+// next to the plain block DDA
+void benchmarkShapes(const Map& source) {
+    const int size = 256;
+    const int rays = 1000000;
+    Map big;
+    tileMap(source, size, big);
+
+    std::vector<glm::vec2> pos, dir;
+    randomRays(big, rays, pos, dir);
+    double total_dist = 0.0;
+    auto cast = [&](auto cast_ray) {
+        total_dist = 0.0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i=0; i<rays; i++) {
+            RayHit hit;
+            if (cast_ray(big, pos[i], dir[i], hit)) total_dist += hit.dist;
+        }
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+    auto cast_ray = [](const Map& map, glm::vec2 p, glm::vec2 d, RayHit& hit) { return castRay(map, p, d, hit); };
+    // the same rays through the plain block DDA, what blocks-only maps paid before shapes,
+    // moving blocks and portals went into castRay; best of a few turns each, one after
+    // the other so neither gets the warmer caches
+    double plain_ms = 1e30;
+    double blocks_ms = 1e30;
+    for (int turn=0; turn<3; turn++) {
+        plain_ms = std::min(plain_ms, cast(castRayBlocks));
+        blocks_ms = std::min(blocks_ms, cast(cast_ray));
+    }
+    // and they have to agree on every hit
+    int differ = 0;
+    for (int i=0; i<rays; i++) {
+        RayHit plain, hit;
+        bool plain_found = castRayBlocks(big, pos[i], dir[i], plain);
+        if (castRay(big, pos[i], dir[i], hit) != plain_found || hit.cell != plain.cell || hit.dist != plain.dist) differ++;
+    }
+
+    // one more material after the map's own, a pillar most of a cell across
+    MaterialLists lists(source.manifest);
+    int pillar = lists.add({0, 0, 0, 0}, 0, 1.0f, SHAPE_PILLAR, 0.4f);
+    lists.build(big.materials.cellCount(), big.materials);
+    int walls = 0;
+    for (int& val : big.grid) {
+        if (val > 0 && walls++ % 4 == 0) val = pillar*4;
+    }
+    double shapes_ms = cast(cast_ray);
+
+    std::cout << "castRay on a " << size << "x" << size << " copy of the map: " << 1e6*blocks_ms/rays
+              << " ns per ray on blocks only against " << 1e6*plain_ms/rays << " ns for the plain block DDA ("
+              << 100.0*(blocks_ms - plain_ms)/plain_ms << "%, " << differ << " rays hit elsewhere), "
+              << 1e6*shapes_ms/rays << " ns with every fourth wall a pillar (" << total_dist/rays << " cells on average)\n";
+}
+
+// Frames of castSpans from a few spots on a big copy of source: the copy as it is, then
+// with stacked_layers more copies of its walls stacked on top, then with every other
+// wall half height, so the column walks on past the low walls in front
+void benchmarkLayers(const Map& source) {
+    const int size = 256;
+    const int frames = 200;
+    const int stacked_layers = 4;
+    Map big;
+    tileMap(source, size, big);
+
+    std::vector<glm::vec2> pos, dir;
+    randomRays(big, frames, pos, dir);
+    float proj_scale = 1.0f/(2*tan(player.vfov/2.0f));
+    SpanBudget budget;
+    budget.max_dist = source.manifest.maxDist();
+    std::vector<WallSpan> spans, see_through;
+    long span_count = 0;
+    auto cast = [&]() {
+        span_count = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int f=0; f<frames; f++) {
+            glm::vec2 plane = glm::vec2(-dir[f].y, dir[f].x) * (float)tan(player.fov/2.0f);
+            for (int i=0; i<scr_x; i++) {
+                glm::vec2 ray_dir = glm::normalize(dir[f] + plane*(2.0f*i/scr_x - 1.0f));
+                spans.clear();
+                see_through.clear();
+                float covered_depth;
+                castSpans(big, pos[f], ray_dir, glm::dot(ray_dir, dir[f]), proj_scale, budget, spans, see_through,
+                          covered_depth);
+                span_count += spans.size();
+            }
+        }
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+    };
+    auto spansPerColumn = [&]() { return (double)span_count/frames/scr_x; };
+
+    double one_ms = cast();
+    double one_spans = spansPerColumn();
+
+    big.stacked_grids.assign(stacked_layers, big.grid);
+    big.wall_top = source.wall_top + stacked_layers*source.manifest.wall_height;
+    double stacked_ms = cast();
+    double stacked_spans = spansPerColumn();
+
+    // a half height copy of each material after the map's own
+    big.stacked_grids.clear();
+    big.wall_top = source.wall_top;
+    MaterialLists lists(source.manifest);
+    int materials = lists.count();
+    for (int m=0; m<materials; m++) {
+        const int* sides = &lists.tex_sides[m*4];
+        lists.add({sides[0], sides[1], sides[2], sides[3]}, lists.flags[m], lists.heights[m]*0.5f, lists.shapes[m],
+                  lists.params[m]);
+    }
+    lists.build(big.materials.cellCount(), big.materials);
+    for (int y=0; y<size; y++) {
+        for (int x=0; x<size; x++) {
+            int& val = big.grid[y*size + x];
+            if (val > 0 && (x+y) % 2 == 0) val += materials*4;
+        }
+    }
+    double mixed_ms = cast();
+    double mixed_spans = spansPerColumn();
+
+    std::cout << "castSpans frames on a " << size << "x" << size << " copy of the map: " << one_ms << " ms with one layer ("
+              << one_spans << " spans per column), " << stacked_ms << " ms with " << stacked_layers+1 << " layers ("
+              << stacked_spans << "), " << mixed_ms << " ms with every other wall half height (" << mixed_spans << ")\n";
+}
+
+// size x size copies of source's walls and floors, for the benchmarks
+void tileMap(const Map& source, int size, Map& big) {
+    big.manifest = source.manifest;
+    big.materials = source.materials;
+    big.wall_top = source.wall_top;
+    big.width = size;
+    big.height = size;
+    big.grid.resize(size*size);
+    big.floor_cells.resize(size*size);
+    for (int y=0; y<size; y++) {
+        for (int x=0; x<size; x++) {
+            int i = (y%source.height)*source.width + x%source.width;
+            big.grid[y*size + x] = source.grid[i];
+            big.floor_cells[y*size + x] = source.floor_cells.empty() ? no_floor_texture : source.floor_cells[i];
+        }
+    }
+}
+
+// count spots in open cells of map, each with a random direction, the same ones every run
+void randomRays(const Map& map, int count, std::vector<glm::vec2>& pos, std::vector<glm::vec2>& dir) {
+    uint32_t seed = 12345;
+    auto random = [&]() {
+        seed = seed*1664525u + 1013904223u;
+        return (seed >> 8) / 16777216.0f;
+    };
+    while ((int)pos.size() < count) {
+        glm::vec2 p(random()*map.width, random()*map.height);
+        if (map.grid[(int)p.y*map.width + (int)p.x] != 0) continue;
+        float ang = random()*6.2831853f;
+        pos.push_back(p);
+        dir.push_back(glm::vec2(cos(ang), sin(ang)));
+    }
+}
+
+MaterialLists::MaterialLists(const MapManifest& manifest)
+    : tex_sides(manifest.tex_sides), flags(manifest.material_flags), heights(manifest.material_heights),
+      shapes(manifest.material_shapes), params(manifest.material_shape_params) {
+    int materials = count();
+    flags.resize(materials, 0);
+    heights.resize(materials, 1.0f);
+    shapes.resize(materials, SHAPE_BLOCK);
+    params.resize(materials, 0.0f);
+}
+
+int MaterialLists::add(std::array<int, 4> sides, uint8_t flag, float height, uint8_t shape, float param) {
+    tex_sides.insert(tex_sides.end(), sides.begin(), sides.end());
+    flags.push_back(flag);
+    heights.push_back(height);
+    shapes.push_back(shape);
+    params.push_back(param);
+    return count() - 1;
+}
+
 void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
     window_to_resize = true;
     window_resize_time = t;
@@ -342,84 +1079,69 @@ void processInput(GLFWwindow *window) {
         perp_dir.y = player.ang_dir.x;
         player.pos -= perp_dir * dt * player_speed;
     }
-}
-
-void castRay(glm::vec2 start_pos, glm::vec2 ray_dir, int* grid, int grid_sx, int grid_sy, float* pDist, float* tex_x, int* tex_index) {
-    float ray_x = start_pos.x;
-    float ray_y = start_pos.y;
-    int grid_x = int(ray_x);
-    int grid_y = int(ray_y);
-    float dist_x, dist_y;
-    float step_x = (ray_dir.x == 0) ? 9999.0f : std::abs(1.0f/ray_dir.x);
-    float step_y = (ray_dir.y == 0) ? 9999.0f : std::abs(1.0f/ray_dir.y);
-    float dist;
-    float maxDist = 100.0f;
-    int grid_step_x, grid_step_y;
-    bool hit = false;
-    int side;
-    
-    // Step calculations
-    if (ray_dir.x < 0) {
-        grid_step_x = -1;
-        dist_x = (ray_x - grid_x) * step_x;
-    }
-    else  {
-        grid_step_x = 1;
-        dist_x = (grid_x + 1.0 - ray_x) * step_x;
+    // number keys switch to maps/map<n>
+    for (int n=1; n<=9; n++) {
+        if (glfwGetKey(window, GLFW_KEY_0 + n) == GLFW_PRESS) {
+            std::string name = "map" + std::to_string(n);
+            if (name != world.name) map_streamer.request(name);
+        }
     }
-    if (ray_dir.y < 0) {
-        grid_step_y = -1;
-        dist_y = (ray_y - grid_y) * step_y;
+    // F1 toggles the per pass timings
+    bool timings_key = glfwGetKey(window, GLFW_KEY_F1) == GLFW_PRESS;
+    if (timings_key && !timings_key_down) show_timings = !show_timings;
+    timings_key_down = timings_key;
+    // E knocks out the wall being looked at, Q puts one up in the free cell ahead
+    bool remove_key = glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS;
+    if (remove_key && !remove_key_down) {
+        RayHit hit;
+        if (castRay(world, player.pos, player.ang_dir, hit) && hit.dist < 2.0f) {
+            map_editor.setCell(hit.cell % world.width, hit.cell / world.width, 0);
+        }
     }
-    else  {
-        grid_step_y = 1;
-        dist_y  = (grid_y + 1.0 - ray_y) * step_y;
+    remove_key_down = remove_key;
+    bool build_key = glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS;
+    if (build_key && !build_key_down) {
+        glm::vec2 ahead = player.pos + player.ang_dir*1.5f;
+        int x = (int)ahead.x;
+        int y = (int)ahead.y;
+        bool own_cell = x == (int)player.pos.x && y == (int)player.pos.y;
+        if (!own_cell && x >= 0 && x < world.width && y >= 0 && y < world.height && world.grid[y*world.width + x] == 0) {
+            map_editor.setCell(x, y, build_cell);
+        }
     }
-    
-    // DDA
-    int grid_val;
-    while (!hit) {
-        if (dist_x < dist_y) {
-            dist_x += step_x;
-            grid_x += grid_step_x;
-            side = 0;
+    build_key_down = build_key;
+    // space pushes a pushwall away from the player, along the face they are looking at
+    bool use_key = glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS;
+    if (use_key && !use_key_down) {
+        RayHit hit;
+        if (castRay(world, player.pos, player.ang_dir, hit) && hit.dist < 2.0f && (hit.flags & MAT_PUSHWALL)) {
+            const int away_x[] = {1, 0, -1, 0};
+            const int away_y[] = {0, -1, 0, 1};
+            startMoving(world, hit.cell % world.width, hit.cell / world.width, away_x[hit.side], away_y[hit.side],
+                        pushwall_cells, pushwall_speed, false, &moved_cells);
         }
+    }
+    use_key_down = use_key;
+    // T lights or puts out the torch, F fires a muzzle flash
+    bool torch_key = glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS;
+    if (torch_key && !torch_key_down) {
+        torch_on = !torch_on;
+        if (torch_on) torch_light = light_grid.addLight(player.pos, torch_level);
         else {
-            dist_y += step_y;
-            grid_y += grid_step_y;
-            side = 1;
-        }
-        if (grid_x < 0 || grid_x >= grid_sx || grid_y < 0 || grid_y >= grid_sy) {
-            break;
+            light_grid.removeLight(torch_light);
+            torch_light = -1;
         }
-        grid_val = grid[grid_y*grid_sy + grid_x];
-        if (grid_val != 0) hit = true;
     }
-    if (side == 0) dist = dist_x - step_x;
-    else dist = dist_y - step_y;
-    
-    float perpDist;
-    if (side == 0)
-        perpDist = (grid_x - start_pos.x + (1 - grid_step_x) * 0.5f) / ray_dir.x;
-    else
-        perpDist = (grid_y - start_pos.y + (1 - grid_step_y) * 0.5f) / ray_dir.y;
-
-    int wall_side;
-    *pDist = dist;
-    if (side == 0) {
-        *tex_x = std::fmod(start_pos.y + perpDist * ray_dir.y, wall_height);
-        wall_side = (grid_step_x == 1) ? 0 : 2;
-    }
-    else if (side == 1) {
-        *tex_x = std::fmod(start_pos.x + perpDist * ray_dir.x, wall_height);
-        wall_side = (grid_step_y == 1) ? 3 : 1;
-    }
-    //*wall_type = grid_val/4;
-    int cell_rotation = grid_val%4;
-    int rotation = cell_rotation + wall_side;
-    if (rotation >= 4) rotation -= 4;
-    *tex_index = grid_val/4*4 + rotation;
+    torch_key_down = torch_key;
+    bool flash_key = glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS;
+    if (flash_key && !flash_key_down) {
+        if (flash_light < 0) flash_light = light_grid.addLight(player.pos + player.ang_dir*0.5f, flash_level);
+        else light_grid.moveLight(flash_light, player.pos + player.ang_dir*0.5f);
+        flash_time = t;
+    }
+    flash_key_down = flash_key;
 }
+
 void mouse_callback(GLFWwindow* window, double xpos, double ypos) {
     if (first_mouse) {
         last_x = xpos;
@@ -0,0 +1,357 @@
+#include "../include/manifest.h"
+#include "../include/assets.h"
+#include "../include/material.h"
+#include <json.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace {
+
+using json = nlohmann::json;
+
+// The smallest a material or entity can be in the file ("{}," or "{}"), so no count
+// hint can ask for more entries than the file has room for
+const size_t min_entry_bytes = 2;
+
+// What the parser is currently inside of. Anything it doesn't know about is Skip,
+// and everything nested in a Skip is ignored too.
+enum class Scope { Root, Spawn, Layers, Atlas, Pages, Rects, Rect, Materials, Material, Faces, Flags, Entities, Entity, Movers, Mover, Lights, Light, LightColour, FogColour, Portals, Portal, Cameras, Camera, Skip };
+
+class ManifestSax : public nlohmann::json_sax<json> {
+public:
+    ManifestSax(MapManifest& aManifest, size_t file_size)
+        : manifest(aManifest), max_hint(file_size / min_entry_bytes) {}
+
+    bool null() override { return true; }
+    bool boolean(bool val) override {
+        if (scope() == Scope::Portal && cur_key == "two_way") manifest.portals.back().two_way = val;
+        return true;
+    }
+    bool number_integer(number_integer_t val) override { return number((double)val); }
+    bool number_unsigned(number_unsigned_t val) override { return number((double)val); }
+    bool number_float(number_float_t val, const string_t&) override { return number(val); }
+    bool binary(binary_t&) override { return true; }
+
+    bool string(string_t& val) override {
+        if (scope() == Scope::Root && cur_key == "walls") manifest.walls = val;
+        else if (scope() == Scope::Root && cur_key == "grid_encoding") manifest.grid_encoding = val;
+        else if (scope() == Scope::Root && cur_key == "floors") manifest.floors = val;
+        else if (scope() == Scope::Root && cur_key == "ceilings") manifest.ceilings = val;
+        else if (scope() == Scope::Root && cur_key == "lightmap") manifest.lightmap = val;
+        else if (scope() == Scope::Atlas && cur_key == "path") manifest.atlas = val;
+        else if (scope() == Scope::Atlas && cur_key == "compression") manifest.compression = val;
+        else if (scope() == Scope::Atlas && cur_key == "virtual_texturing") manifest.virtual_texturing = val;
+        else if (scope() == Scope::Portal && (cur_key == "side" || cur_key == "to_side")) {
+            const char* names[] = {"west", "south", "east", "north"};
+            int side = std::find(names, names + 4, val) - names;
+            if (side == 4) std::cout << "Unknown portal side " << val << ", has to be west, south, east or north.\n";
+            (cur_key == "side" ? manifest.portals.back().side : manifest.portals.back().to_side) = side % 4;
+        }
+        else if (scope() == Scope::Pages) manifest.atlas_pages.push_back(val);
+        else if (scope() == Scope::Layers) manifest.layers.push_back(val);
+        else if (scope() == Scope::Material && cur_key == "shape") {
+            uint8_t& shape = manifest.material_shapes.back();
+            if (val == "thin") shape = SHAPE_THIN;
+            else if (val == "door") shape = SHAPE_DOOR;
+            else if (val == "diagonal") shape = SHAPE_DIAGONAL;
+            else if (val == "pillar") shape = SHAPE_PILLAR;
+        }
+        else if (scope() == Scope::Flags) {
+            uint8_t& flags = manifest.material_flags.back();
+            if (val == "transparent") flags |= MAT_TRANSPARENT;
+            else if (val == "door") flags |= MAT_DOOR;
+            else if (val == "emissive") flags |= MAT_EMISSIVE;
+            else if (val == "pushwall") flags |= MAT_PUSHWALL;
+            else if (val == "mirror") flags |= MAT_MIRROR;
+        }
+        return true;
+    }
+
+    bool key(string_t& val) override {
+        cur_key = val;
+        return true;
+    }
+
+    bool start_object(std::size_t) override {
+        Scope parent = scope();
+        if (stack.empty()) stack.push_back(Scope::Root);
+        else if (parent == Scope::Root && cur_key == "spawn") stack.push_back(Scope::Spawn);
+        else if (parent == Scope::Root && cur_key == "atlas") stack.push_back(Scope::Atlas);
+        else if (parent == Scope::Rects) {
+            manifest.atlas_rects.emplace_back();
+            stack.push_back(Scope::Rect);
+        }
+        else if (parent == Scope::Materials) {
+            // every material starts out all zero, faces/texture fill it in
+            manifest.tex_sides.insert(manifest.tex_sides.end(), 4, 0);
+            manifest.material_flags.push_back(0);
+            manifest.material_heights.push_back(1.0f);
+            manifest.material_shapes.push_back(SHAPE_BLOCK);
+            manifest.material_shape_params.push_back(0.0f);
+            manifest.material_cameras.push_back(-1);
+            shape_param_set = false;
+            face = 0;
+            stack.push_back(Scope::Material);
+        }
+        else if (parent == Scope::Entities) {
+            manifest.entities.emplace_back();
+            stack.push_back(Scope::Entity);
+        }
+        else if (parent == Scope::Movers) {
+            manifest.movers.emplace_back();
+            stack.push_back(Scope::Mover);
+        }
+        else if (parent == Scope::Lights) {
+            manifest.lights.emplace_back();
+            stack.push_back(Scope::Light);
+        }
+        else if (parent == Scope::Portals) {
+            manifest.portals.emplace_back();
+            stack.push_back(Scope::Portal);
+        }
+        else if (parent == Scope::Cameras) {
+            manifest.cameras.emplace_back();
+            stack.push_back(Scope::Camera);
+        }
+        else stack.push_back(Scope::Skip);
+        cur_key.clear();
+        return true;
+    }
+
+    bool end_object() override {
+        // a shape without its parameter sits in the middle of the cell, doors closed
+        if (scope() == Scope::Material && !shape_param_set) {
+            uint8_t shape = manifest.material_shapes.back();
+            manifest.material_shape_params.back() = shape == SHAPE_DOOR ? 0.0f : 0.5f;
+        }
+        stack.pop_back();
+        return true;
+    }
+
+    bool start_array(std::size_t) override {
+        Scope parent = scope();
+        if (parent == Scope::Root && cur_key == "materials") {
+            manifest.tex_sides.clear();
+            manifest.tex_sides.reserve(material_hint*4);
+            manifest.material_flags.clear();
+            manifest.material_flags.reserve(material_hint);
+            manifest.material_heights.clear();
+            manifest.material_heights.reserve(material_hint);
+            manifest.material_shapes.clear();
+            manifest.material_shapes.reserve(material_hint);
+            manifest.material_shape_params.clear();
+            manifest.material_shape_params.reserve(material_hint);
+            manifest.material_cameras.clear();
+            manifest.material_cameras.reserve(material_hint);
+            stack.push_back(Scope::Materials);
+        }
+        else if (parent == Scope::Root && cur_key == "entities") {
+            manifest.entities.clear();
+            manifest.entities.reserve(entity_hint);
+            stack.push_back(Scope::Entities);
+        }
+        else if (parent == Scope::Root && cur_key == "lights") {
+            manifest.lights.clear();
+            stack.push_back(Scope::Lights);
+        }
+        else if (parent == Scope::Light && cur_key == "colour") {
+            component = 0;
+            stack.push_back(Scope::LightColour);
+        }
+        else if (parent == Scope::Root && cur_key == "fog_colour") {
+            component = 0;
+            stack.push_back(Scope::FogColour);
+        }
+        else if (parent == Scope::Root && cur_key == "portals") {
+            manifest.portals.clear();
+            stack.push_back(Scope::Portals);
+        }
+        else if (parent == Scope::Root && cur_key == "cameras") {
+            manifest.cameras.clear();
+            stack.push_back(Scope::Cameras);
+        }
+        else if (parent == Scope::Root && cur_key == "movers") {
+            manifest.movers.clear();
+            stack.push_back(Scope::Movers);
+        }
+        else if (parent == Scope::Root && cur_key == "layers") {
+            manifest.layers.clear();
+            stack.push_back(Scope::Layers);
+        }
+        else if (parent == Scope::Atlas && cur_key == "pages") {
+            manifest.atlas_pages.clear();
+            stack.push_back(Scope::Pages);
+        }
+        else if (parent == Scope::Atlas && cur_key == "rects") {
+            manifest.atlas_rects.clear();
+            stack.push_back(Scope::Rects);
+        }
+        else if (parent == Scope::Material && cur_key == "faces") stack.push_back(Scope::Faces);
+        else if (parent == Scope::Material && cur_key == "flags") stack.push_back(Scope::Flags);
+        else stack.push_back(Scope::Skip);
+        return true;
+    }
+
+    bool end_array() override {
+        stack.pop_back();
+        return true;
+    }
+
+    bool parse_error(std::size_t position, const std::string&, const nlohmann::detail::exception& ex) override {
+        std::cout << "Error: manifest parse failed at byte " << position << ".\n" << ex.what() << "\n";
+        return false;
+    }
+
+private:
+    MapManifest& manifest;
+    std::vector<Scope> stack;
+    std::string cur_key;
+    size_t material_hint = 0;
+    size_t entity_hint = 0;
+    size_t max_hint;
+    int face = 0;
+    bool shape_param_set = false;
+    int component = 0;
+
+    Scope scope() const {
+        if (stack.empty() || stack.back() == Scope::Skip) return Scope::Skip;
+        return stack.back();
+    }
+
+    // A count hint only sizes tables up front, so anything that isn't a whole number of
+    // entries is ignored and it never goes past what the file could hold
+    size_t countHint(double val) const {
+        if (!(val >= 0.0) || val != std::floor(val)) return 0;
+        return val < (double)max_hint ? (size_t)val : max_hint;
+    }
+
+    bool number(double val) {
+        switch (scope()) {
+        case Scope::Root:
+            if (cur_key == "wall_height") manifest.wall_height = val;
+            else if (cur_key == "material_count") material_hint = countHint(val);
+            else if (cur_key == "entity_count") entity_hint = countHint(val);
+            else if (cur_key == "floor_material") manifest.floor_material = val;
+            else if (cur_key == "ceiling_material") manifest.ceiling_material = val;
+            else if (cur_key == "sky_texture") manifest.sky_texture = val;
+            else if (cur_key == "sky_repeats") manifest.sky_repeats = val;
+            else if (cur_key == "transparent_hits") manifest.transparent_hits = val;
+            else if (cur_key == "ambient") manifest.ambient = val;
+            else if (cur_key == "view_distance") manifest.view_distance = val;
+            else if (cur_key == "fog_start") manifest.fog_start = val;
+            else if (cur_key == "lod_distance") manifest.lod_distance = val;
+            break;
+        case Scope::Spawn:
+            if (cur_key == "x") manifest.spawn_pos.x = val;
+            else if (cur_key == "y") manifest.spawn_pos.y = val;
+            else if (cur_key == "angle") manifest.spawn_ang = glm::radians(val);
+            break;
+        case Scope::Atlas:
+            if (cur_key == "tiles_x") manifest.atlas_tiles_x = val;
+            else if (cur_key == "tiles_y") manifest.atlas_tiles_y = val;
+            else if (cur_key == "padding") manifest.atlas_padding = val;
+            else if (cur_key == "virtual_budget_mb") manifest.virtual_budget_mb = val;
+            break;
+        case Scope::Rect: {
+            AtlasRect& rect = manifest.atlas_rects.back();
+            if (cur_key == "page") rect.page = val;
+            else if (cur_key == "x") rect.x = val;
+            else if (cur_key == "y") rect.y = val;
+            else if (cur_key == "w") rect.w = val;
+            else if (cur_key == "h") rect.h = val;
+            break;
+        }
+        case Scope::Material:
+            // "texture": n is shorthand for the same texture on all four faces
+            if (cur_key == "texture") {
+                for (int i=0; i<4; i++) manifest.tex_sides[manifest.tex_sides.size()-4+i] = val;
+            }
+            else if (cur_key == "height") manifest.material_heights.back() = val;
+            else if (cur_key == "camera") {
+                manifest.material_cameras.back() = val;
+                manifest.material_flags.back() |= MAT_MONITOR;
+            }
+            else if (cur_key == "offset" || cur_key == "open" || cur_key == "radius") {
+                manifest.material_shape_params.back() = val;
+                shape_param_set = true;
+            }
+            break;
+        case Scope::Faces:
+            if (face < 4) manifest.tex_sides[manifest.tex_sides.size()-4+face] = val;
+            face++;
+            break;
+        case Scope::Entity: {
+            Entity& entity = manifest.entities.back();
+            if (cur_key == "type") entity.type = val;
+            else if (cur_key == "x") entity.pos.x = val;
+            else if (cur_key == "y") entity.pos.y = val;
+            else if (cur_key == "angle") entity.ang = glm::radians(val);
+            else if (cur_key == "texture") entity.texture = val;
+            else if (cur_key == "size") entity.size = val;
+            break;
+        }
+        case Scope::Light: {
+            Light& light = manifest.lights.back();
+            if (cur_key == "x") light.pos.x = val;
+            else if (cur_key == "y") light.pos.y = val;
+            else if (cur_key == "intensity") light.intensity = val;
+            else if (cur_key == "radius") light.radius = val;
+            else if (cur_key == "size") light.size = val;
+            break;
+        }
+        case Scope::LightColour:
+            if (component < 3) manifest.lights.back().colour[component] = val;
+            component++;
+            break;
+        case Scope::Portal: {
+            Portal& portal = manifest.portals.back();
+            if (cur_key == "x") portal.x = val;
+            else if (cur_key == "y") portal.y = val;
+            else if (cur_key == "to_x") portal.to_x = val;
+            else if (cur_key == "to_y") portal.to_y = val;
+            break;
+        }
+        case Scope::Camera: {
+            SecurityCamera& camera = manifest.cameras.back();
+            if (cur_key == "x") camera.pos.x = val;
+            else if (cur_key == "y") camera.pos.y = val;
+            else if (cur_key == "angle") camera.ang = glm::radians(val);
+            else if (cur_key == "fov") camera.fov = glm::radians(val);
+            break;
+        }
+        case Scope::FogColour:
+            if (component < 3) manifest.fog_colour[component] = val;
+            component++;
+            break;
+        case Scope::Mover: {
+            Mover& mover = manifest.movers.back();
+            if (cur_key == "x") mover.x = val;
+            else if (cur_key == "y") mover.y = val;
+            else if (cur_key == "dx") mover.dx = val;
+            else if (cur_key == "dy") mover.dy = val;
+            else if (cur_key == "cells") mover.cells = val;
+            else if (cur_key == "speed") mover.speed = val;
+            break;
+        }
+        default:
+            break;
+        }
+        return true;
+    }
+};
+
+}
+
+bool loadManifest(const std::string& path, MapManifest& manifest) {
+    Asset file;
+    if (!loadAsset(path, file)) return false;
+
+    ManifestSax sax(manifest, file.size);
+    if (!json::sax_parse(file.data, file.data + file.size, &sax)) {
+        std::cout << "Error: " << path << " is not a valid manifest.\n";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,383 @@
+#include "../include/map.h"
+#include "../include/texture_compress.h"
+#include "../include/assets.h"
+#include "../include/moving_blocks.h"
+#include "../include/portals.h"
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <thread>
+
+namespace {
+
+void setAtlasParameters(const Map& map) {
+    if (map.virtual_texture) return;
+    // a layer per texture can wrap freely, shared pages have to stay inside their rects
+    GLenum wrap = map.texture_per_layer ? GL_REPEAT : GL_CLAMP_TO_EDGE;
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, wrap);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, wrap);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    float max_anisotropy = 1.0f;
+    glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY, &max_anisotropy);
+    glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_ANISOTROPY, std::min(8.0f, max_anisotropy));
+}
+
+// Slices are uploaded smallest level first, every layer of a level before the next one
+int sliceCount(const Map& map) {
+    return map.atlas_levels * map.atlas_layers.size();
+}
+
+size_t uploadSlice(const Map& map, int slice) {
+    int layers = map.atlas_layers.size();
+    int level = map.atlas_levels-1 - slice/layers;
+    int layer = slice%layers;
+    uploadAtlasLevel(map.atlas_layers[layer], layer, level);
+    return map.atlas_layers[layer].levels[level].size();
+}
+
+// Decodes a grid png (walls, floors, ceilings) into cell values, see MapManifest::grid_encoding
+bool loadGrid(const std::string& path, const std::string& encoding, int& width, int& height,
+              std::vector<int>& grid, int& max_cell) {
+    Asset file;
+    int channels;
+    unsigned char *data = nullptr;
+    if (loadAsset(path, file)) data = stbi_load_from_memory(file.data, file.size, &width, &height, &channels, 3);
+    if (!data) {
+        std::cout << "Map " << path << " did not load.\n";
+        return false;
+    }
+    grid.resize(width * height);
+    bool material16 = encoding == "material16";
+    for (int i=0; i<width*height; i++) {
+        if (material16) {
+            int material = data[i*3+0]*256 + data[i*3+1];
+            grid[i] = material*4 + data[i*3+2]/64;
+        }
+        else {
+            int r = data[i*3+0]+1;   // Greater digit
+            int g = data[i*3+1]+1;   // Lesser digit
+            int b = data[i*3+2]+1;   // Rotation
+            grid[i] = r/4 + g/16 + b/64;
+        }
+        max_cell = std::max(max_cell, grid[i]);
+    }
+    stbi_image_free(data);
+    return true;
+}
+
+void createMapObjects(Map& map) {
+    if (map.virtual_texture) map.virtual_texture->create((size_t)map.manifest.virtual_budget_mb << 20);
+    else map.atlas_texture = createAtlasArray(map.atlas_layers[0], map.atlas_layers.size(), map.atlas_levels);
+    glGenBuffers(1, &map.rects_buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, map.rects_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, map.texture_rects.size()*sizeof(TextureRect),
+                 map.texture_rects.data(), GL_STATIC_DRAW);
+    glGenBuffers(1, &map.floor_buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, map.floor_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, map.floor_cells.size()*sizeof(uint32_t),
+                 map.floor_cells.data(), GL_STATIC_DRAW);
+}
+
+bool loadAtlas(const std::string& dir, Map& map) {
+    const MapManifest& manifest = map.manifest;
+    bool packed = !manifest.atlas_rects.empty();
+    std::vector<std::string> pages = manifest.atlas_pages;
+    if (pages.empty()) pages.push_back(manifest.atlas);
+
+    // packed pages get plain mips, their padding is what keeps rects apart
+    int tiles_x = packed ? 1 : manifest.atlas_tiles_x;
+    int tiles_y = packed ? 1 : manifest.atlas_tiles_y;
+    std::vector<AtlasImage> images(pages.size());
+    for (size_t i=0; i<pages.size(); i++) {
+        if (!loadAtlasImage(dir + pages[i], tiles_x, tiles_y, images[i])) {
+            std::cout << "Texture " << dir + pages[i] << " did not load.\n";
+            return false;
+        }
+        if (images[i].width != images[0].width || images[i].height != images[0].height) {
+            std::cout << "Atlas page " << dir + pages[i] << " is not the size of the first page.\n";
+            return false;
+        }
+    }
+
+    // a rect has to lie inside its page, the pages are all the first one's size
+    for (const AtlasRect& rect : manifest.atlas_rects) {
+        if (rect.page < 0 || rect.page >= (int)images.size() || rect.w <= 0 || rect.h <= 0 || rect.x < 0 ||
+            rect.y < 0 || rect.x > images[0].width - rect.w || rect.y > images[0].height - rect.h) {
+            std::cout << "Atlas rect " << rect.x << "," << rect.y << " " << rect.w << "x" << rect.h << " on page "
+                      << rect.page << " is not inside a page.\n";
+            return false;
+        }
+    }
+
+    // Every texture gets its own array layer with its own full mip chain whenever the
+    // textures are all the same size: no bleeding at any level, trilinear all the way
+    // down, and each wall only ever touches its own texels.
+    bool same_size = packed;
+    for (const AtlasRect& rect : manifest.atlas_rects) {
+        if (rect.w != manifest.atlas_rects[0].w || rect.h != manifest.atlas_rects[0].h) same_size = false;
+    }
+    map.texture_per_layer = !packed || same_size;
+    map.texture_rects.clear();
+    if (!packed) {
+        splitTiles(images[0], map.atlas_layers);
+    }
+    else if (same_size) {
+        map.atlas_layers.resize(manifest.atlas_rects.size());
+        for (size_t i=0; i<manifest.atlas_rects.size(); i++) {
+            const AtlasRect& rect = manifest.atlas_rects[i];
+            extractRect(images[rect.page], rect.x, rect.y, rect.w, rect.h, map.atlas_layers[i]);
+        }
+    }
+    if (map.texture_per_layer) {
+        map.atlas_levels = map.atlas_layers[0].levels.size();
+        for (size_t i=0; i<map.atlas_layers.size(); i++) {
+            TextureRect entry = {};
+            entry.uv = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+            entry.page = i;
+            map.texture_rects.push_back(entry);
+        }
+        return true;
+    }
+
+    // mixed sizes stay on their packed pages
+    map.atlas_layers = std::move(images);
+    const AtlasImage& first = map.atlas_layers[0];
+    // below this level the gutter is gone and neighbouring rects start to bleed
+    int levels = 1;
+    while ((manifest.atlas_padding >> levels) > 0) levels++;
+    map.atlas_levels = std::min((int)first.levels.size(), levels);
+    for (const AtlasRect& rect : manifest.atlas_rects) {
+        TextureRect entry = {};
+        entry.uv = glm::vec4((float)rect.x/first.width, (float)rect.y/first.height,
+                             (float)rect.w/first.width, (float)rect.h/first.height);
+        entry.page = rect.page;
+        map.texture_rects.push_back(entry);
+    }
+    return true;
+}
+
+// All layers share one texture array, so they all get the same format: the widest one
+// any layer asks for, or RGBA8 if one of them can't be compressed at all.
+void compressLayers(Map& map) {
+    std::vector<AtlasImage>& layers = map.atlas_layers;
+    TextureFormat format = TEX_BC1;
+    for (const AtlasImage& layer : layers) {
+        TextureFormat wanted = chooseFormat(layer, map.manifest.compression);
+        if (wanted == TEX_RGBA8) format = TEX_RGBA8;
+        else if (format != TEX_RGBA8) format = std::max(format, wanted);
+    }
+    if (layers.empty() || format == TEX_RGBA8) return;
+
+    size_t raw_bytes = 0;
+    for (const AtlasImage& layer : layers) {
+        for (int level=0; level<map.atlas_levels; level++) raw_bytes += layer.levelSize(level);
+    }
+    auto start = std::chrono::steady_clock::now();
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min(threads, (int)layers.size());
+    std::vector<std::thread> workers;
+    for (int t=0; t<threads; t++) {
+        workers.emplace_back([&layers, format, t, threads]() {
+            for (size_t i=t; i<layers.size(); i+=threads) compressImage(layers[i], format);
+        });
+    }
+    for (std::thread& worker : workers) worker.join();
+    float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    size_t bytes = 0;
+    for (const AtlasImage& layer : layers) {
+        for (int level=0; level<map.atlas_levels; level++) bytes += layer.levelSize(level);
+    }
+    std::cout << map.name << ": atlas is " << bytes/1024 << " KiB as " << (format == TEX_BC1 ? "BC1" : "BC7")
+              << ", " << raw_bytes/1024 << " KiB as RGBA8, saved " << (raw_bytes-bytes)/1024 << " KiB ("
+              << ms << " ms)\n";
+}
+
+}
+
+bool loadMap(const std::string& name, Map& map) {
+    map.name = name;
+    std::string dir = "maps/" + name + "/";
+    map.manifest = MapManifest();
+    if (assetExists(dir + "map.json") && !loadManifest(dir + "map.json", map.manifest)) {
+        map.manifest = MapManifest();
+    }
+    // written by atlas_packer, only carries the "atlas" section
+    if (assetExists(dir + "atlas.json")) loadManifest(dir + "atlas.json", map.manifest);
+    if (map.manifest.fog_start < 0.0f) map.manifest.fog_start = map.manifest.view_distance*0.5f;
+    if (map.manifest.lod_distance < 0.0f) map.manifest.lod_distance = map.manifest.view_distance*0.25f;
+
+    int max_cell = 0;
+    if (!loadGrid(dir + map.manifest.walls, map.manifest.grid_encoding, map.width, map.height, map.grid, max_cell)) {
+        return false;
+    }
+    int width, height;
+    map.stacked_grids.clear();
+    for (const std::string& layer : map.manifest.layers) {
+        std::vector<int> grid;
+        if (!loadGrid(dir + layer, map.manifest.grid_encoding, width, height, grid, max_cell)) return false;
+        if (width != map.width || height != map.height) {
+            std::cout << "Layer " << layer << " is not the size of the map.\n";
+            return false;
+        }
+        map.stacked_grids.push_back(std::move(grid));
+    }
+    // floors and ceilings are cell values too, only their first face is used
+    std::vector<int> floors, ceilings;
+    if (!map.manifest.floors.empty() && loadGrid(dir + map.manifest.floors, map.manifest.grid_encoding,
+                                                 width, height, floors, max_cell) && (width != map.width || height != map.height)) {
+        std::cout << "Floor grid " << map.manifest.floors << " is not the size of the map.\n";
+        floors.clear();
+    }
+    if (!map.manifest.ceilings.empty() && loadGrid(dir + map.manifest.ceilings, map.manifest.grid_encoding,
+                                                   width, height, ceilings, max_cell) && (width != map.width || height != map.height)) {
+        std::cout << "Ceiling grid " << map.manifest.ceilings << " is not the size of the map.\n";
+        ceilings.clear();
+    }
+    int floor_cell = map.manifest.floor_material*4;
+    int ceiling_cell = map.manifest.ceiling_material*4;
+    max_cell = std::max({max_cell, floor_cell, ceiling_cell});
+    buildMaterialTable(map.manifest.tex_sides, map.manifest.material_flags, map.manifest.material_heights,
+                       map.manifest.material_shapes, map.manifest.material_shape_params, max_cell+1, map.materials);
+    // the column renderer can stop once everything up to here is covered
+    float wall_height = map.manifest.wall_height;
+    map.wall_top = 0.0f;
+    for (int layer=0; layer<=(int)map.stacked_grids.size(); layer++) {
+        const std::vector<int>& grid = layer == 0 ? map.grid : map.stacked_grids[layer-1];
+        for (int val : grid) {
+            if (val != 0) map.wall_top = std::max(map.wall_top, (layer + map.materials.height[val])*wall_height);
+        }
+    }
+
+    map.moving_cells.clear();
+    map.moving_blocks.clear();
+    for (const Mover& mover : map.manifest.movers) {
+        if (!startMoving(map, mover.x, mover.y, mover.dx, mover.dy, mover.cells, mover.speed, true)) {
+            std::cout << "Mover at " << mover.x << ", " << mover.y << " has no wall or no room to move.\n";
+        }
+    }
+
+    map.portals.clear();
+    for (const Portal& portal : map.manifest.portals) {
+        if (!linkPortal(map, portal)) {
+            std::cout << "Portal at " << portal.x << ", " << portal.y << " leads off the map.\n";
+        }
+    }
+
+    map.floor_cells.resize(map.width * map.height);
+    for (int i=0; i<map.width*map.height; i++) {
+        int floor = floors.empty() ? floor_cell : floors[i];
+        int ceiling = ceilings.empty() ? ceiling_cell : ceilings[i];
+        uint32_t floor_tex = floor > 0 ? map.materials.face_tex[floor*4] : no_floor_texture;
+        uint32_t ceiling_tex = ceiling > 0 ? map.materials.face_tex[ceiling*4] : no_floor_texture;
+        map.floor_cells[i] = floor_tex | (ceiling_tex << 16);
+    }
+
+    // optional, light_baker writes it
+    map.lightmap = Lightmap();
+    if (!map.manifest.lightmap.empty() && assetExists(dir + map.manifest.lightmap) &&
+        !loadLightmap(dir + map.manifest.lightmap, map.width, map.height, map.lightmap)) {
+        std::cout << "Lightmap " << map.manifest.lightmap << " is out of date or broken, walls are unlit.\n";
+    }
+
+    map.sprites.clear();
+    map.sprites.reserve(map.manifest.entities.size());
+    for (const Entity& entity : map.manifest.entities) {
+        map.sprites.push_back({entity.pos, entity.size, entity.texture});
+    }
+
+    if (!loadAtlas(dir, map)) return false;
+    // face_tex only has 16 bits, an index the atlas doesn't have would wrap into one it does
+    int texture_count = map.texture_rects.size();
+    for (size_t i=0; i<map.manifest.tex_sides.size(); i++) {
+        int tex = map.manifest.tex_sides[i];
+        if (tex < 0 || tex >= texture_count) {
+            std::cout << "Material " << i/4 << " face " << i%4 << " uses texture " << tex << ", the atlas has "
+                      << texture_count << ".\n";
+            return false;
+        }
+    }
+
+    const std::string& mode = map.manifest.virtual_texturing;
+    bool virtual_texturing = mode == "on" || (mode == "auto" && (int)map.atlas_layers.size() > virtual_texture_threshold);
+    if (virtual_texturing && map.texture_per_layer) {
+        map.virtual_texture = std::make_unique<VirtualTexture>();
+        if (map.virtual_texture->build(map.atlas_layers, map.atlas_levels)) {
+            // everything from here on comes out of the page file
+            map.atlas_layers.clear();
+            map.atlas_layers.shrink_to_fit();
+            return true;
+        }
+        std::cout << "Virtual texture for " << name << " could not be built, using the atlas.\n";
+        map.virtual_texture.reset();
+    }
+    compressLayers(map);
+    return true;
+}
+
+void uploadMap(Map& map) {
+    createMapObjects(map);
+    for (int slice=0; slice<sliceCount(map); slice++) uploadSlice(map, slice);
+    setAtlasParameters(map);
+}
+
+void releaseMap(Map& map) {
+    if (map.virtual_texture) map.virtual_texture->release();
+    map.virtual_texture.reset();
+    if (map.atlas_texture != 0) glDeleteTextures(1, &map.atlas_texture);
+    if (map.rects_buffer != 0) glDeleteBuffers(1, &map.rects_buffer);
+    if (map.floor_buffer != 0) glDeleteBuffers(1, &map.floor_buffer);
+    map.atlas_texture = 0;
+    map.rects_buffer = 0;
+    map.floor_buffer = 0;
+}
+
+bool MapStreamer::request(const std::string& name) {
+    if (busy()) return false;
+    if (!assetExists("maps/" + name + "/map.json") && !std::filesystem::exists("maps/" + name)) return false;
+    loading = std::async(std::launch::async, [name]() {
+        std::unique_ptr<Map> map = std::make_unique<Map>();
+        if (!loadMap(name, *map)) map.reset();
+        return map;
+    });
+    return true;
+}
+
+bool MapStreamer::busy() const {
+    return loading.valid() || staged != nullptr;
+}
+
+bool MapStreamer::update(Map& current) {
+    if (loading.valid()) {
+        if (loading.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return false;
+        staged = loading.get();
+        if (!staged) return false;
+        createMapObjects(*staged);
+        next_slice = 0;
+    }
+    if (!staged) return false;
+
+    // smallest levels first, so one frame never has to push the whole chain
+    glBindTexture(GL_TEXTURE_2D_ARRAY, staged->atlas_texture);
+    size_t uploaded = 0;
+    int slices = sliceCount(*staged);
+    while (next_slice < slices && uploaded < upload_budget) {
+        uploaded += uploadSlice(*staged, next_slice);
+        next_slice++;
+    }
+    if (next_slice < slices) {
+        glBindTexture(GL_TEXTURE_2D_ARRAY, current.atlas_texture);
+        return false;
+    }
+    setAtlasParameters(*staged);
+
+    releaseMap(current);
+    current = std::move(*staged);
+    staged.reset();
+    return true;
+}
@@ -0,0 +1,118 @@
+#include "../include/map_edits.h"
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+
+namespace {
+
+uint32_t floorTexture(const Map& map, int value) {
+    return value > 0 ? map.materials.face_tex[value*4] : no_floor_texture;
+}
+
+}
+
+void MapEditor::setCell(int x, int y, int value, int layer) {
+    CellEdit edit;
+    edit.x = x;
+    edit.y = y;
+    edit.value = value;
+    edit.layer = layer;
+    queued.push_back(edit);
+}
+
+void MapEditor::setFloor(int x, int y, int value) {
+    CellEdit edit;
+    edit.x = x;
+    edit.y = y;
+    edit.value = value;
+    edit.target = EDIT_FLOOR;
+    queued.push_back(edit);
+}
+
+void MapEditor::setCeiling(int x, int y, int value) {
+    CellEdit edit;
+    edit.x = x;
+    edit.y = y;
+    edit.value = value;
+    edit.target = EDIT_CEILING;
+    queued.push_back(edit);
+}
+
+void MapEditor::addListener(MapListener* listener) {
+    if (std::find(listeners.begin(), listeners.end(), listener) == listeners.end()) listeners.push_back(listener);
+}
+
+void MapEditor::removeListener(MapListener* listener) {
+    listeners.erase(std::remove(listeners.begin(), listeners.end(), listener), listeners.end());
+}
+
+void MapEditor::notify(const Map& map, const std::vector<CellEdit>& edits) {
+    if (edits.empty()) return;
+    for (MapListener* listener : listeners) listener->cellsChanged(map, edits);
+}
+
+void MapEditor::apply(Map& map) {
+    if (queued.empty()) return;
+    auto start = std::chrono::steady_clock::now();
+    applied.clear();
+
+    // a value past the end of the material table gets the table regrown once for the batch
+    int max_value = -1;
+    for (const CellEdit& edit : queued) max_value = std::max(max_value, edit.value);
+    if (max_value >= map.materials.cellCount()) {
+        buildMaterialTable(map.manifest.tex_sides, map.manifest.material_flags, map.manifest.material_heights,
+                           map.manifest.material_shapes, map.manifest.material_shape_params, max_value+1, map.materials);
+    }
+
+    float wall_height = map.manifest.wall_height;
+    int layer_count = 1 + map.stacked_grids.size();
+    bool has_floors = map.floor_cells.size() == (size_t)map.width*map.height;
+    int floor_first = map.width*map.height;
+    int floor_last = -1;
+    for (CellEdit& edit : queued) {
+        if (edit.x < 0 || edit.x >= map.width || edit.y < 0 || edit.y >= map.height || edit.value < 0) continue;
+        int i = edit.y*map.width + edit.x;
+        if (edit.target == EDIT_WALL) {
+            if (edit.layer < 0 || edit.layer >= layer_count) continue;
+            int& cell = edit.layer == 0 ? map.grid[i] : map.stacked_grids[edit.layer-1][i];
+            // cells under a moving block belong to it until it stops
+            if (cell == edit.value || cell == moving_cell) continue;
+            edit.old_value = cell;
+            cell = edit.value;
+            if (edit.value != 0) {
+                map.wall_top = std::max(map.wall_top, (edit.layer + map.materials.height[edit.value])*wall_height);
+            }
+        }
+        else {
+            if (!has_floors) continue;
+            uint32_t packed = map.floor_cells[i];
+            uint32_t tex = floorTexture(map, edit.value);
+            if (edit.target == EDIT_FLOOR) packed = (packed & 0xffff0000) | tex;
+            else packed = (packed & 0xffff) | (tex << 16);
+            if (packed == map.floor_cells[i]) continue;
+            map.floor_cells[i] = packed;
+            floor_first = std::min(floor_first, i);
+            floor_last = std::max(floor_last, i);
+        }
+        applied.push_back(edit);
+    }
+    queued.clear();
+
+    // one upload over the span of cells that changed, not the whole buffer
+    if (floor_last >= floor_first && map.floor_buffer != 0) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, map.floor_buffer);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, floor_first*sizeof(uint32_t),
+                        (floor_last - floor_first + 1)*sizeof(uint32_t), map.floor_cells.data() + floor_first);
+    }
+    auto written = std::chrono::steady_clock::now();
+    if (!applied.empty()) {
+        for (MapListener* listener : listeners) listener->cellsChanged(map, applied);
+    }
+    auto done = std::chrono::steady_clock::now();
+
+    timing.batches++;
+    timing.cells += applied.size();
+    timing.apply_ms += std::chrono::duration<double, std::milli>(written - start).count();
+    timing.listeners_ms += std::chrono::duration<double, std::milli>(done - written).count();
+}
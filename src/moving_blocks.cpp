@@ -0,0 +1,103 @@
+#include "../include/moving_blocks.h"
+
+#include <cstdlib>
+
+namespace {
+
+bool freeCell(const Map& map, int x, int y) {
+    return x >= 0 && x < map.width && y >= 0 && y < map.height && map.grid[y*map.width + x] == 0;
+}
+
+void record(std::vector<CellEdit>* changed, int x, int y, int value, int old_value) {
+    if (!changed) return;
+    CellEdit edit;
+    edit.x = x;
+    edit.y = y;
+    edit.value = value;
+    edit.old_value = old_value;
+    changed->push_back(edit);
+}
+
+void claim(Map& map, int x, int y, int block, std::vector<CellEdit>* changed) {
+    int cell = y*map.width + x;
+    record(changed, x, y, moving_cell, map.grid[cell]);
+    map.grid[cell] = moving_cell;
+    map.moving_cells[cell] = block;
+}
+
+void release(Map& map, int x, int y, int value, std::vector<CellEdit>* changed) {
+    int cell = y*map.width + x;
+    record(changed, x, y, value, map.grid[cell]);
+    map.grid[cell] = value;
+    map.moving_cells.erase(cell);
+}
+
+// Moves block on, false once it has stopped and is back in the grid as a plain wall
+bool advance(Map& map, int index, float dt, std::vector<CellEdit>* changed) {
+    MovingBlock& block = map.moving_blocks[index];
+    block.offset += block.speed*dt;
+    while (block.offset >= 1.0f) {
+        // all the way into the next cell, the one behind is free again
+        release(map, block.x, block.y, 0, changed);
+        block.x += block.dx;
+        block.y += block.dy;
+        block.offset -= 1.0f;
+        if (block.remaining <= 0 && block.ping_pong) {
+            block.dx = -block.dx;
+            block.dy = -block.dy;
+            block.remaining = block.cells;
+        }
+        if (block.remaining <= 0 || !freeCell(map, block.x + block.dx, block.y + block.dy)) {
+            release(map, block.x, block.y, block.value, changed);
+            return false;
+        }
+        block.remaining--;
+        claim(map, block.x + block.dx, block.y + block.dy, index, changed);
+    }
+    return true;
+}
+
+}
+
+bool startMoving(Map& map, int x, int y, int dx, int dy, int cells, float speed, bool ping_pong,
+                 std::vector<CellEdit>* changed) {
+    if ((dx != 0) == (dy != 0) || std::abs(dx + dy) != 1 || cells < 1) return false;
+    if (x < 0 || x >= map.width || y < 0 || y >= map.height) return false;
+    int value = map.grid[y*map.width + x];
+    if (value <= 0 || !freeCell(map, x + dx, y + dy)) return false;
+
+    MovingBlock block;
+    block.value = value;
+    block.x = x;
+    block.y = y;
+    block.dx = dx;
+    block.dy = dy;
+    block.speed = speed;
+    block.remaining = cells - 1;
+    block.cells = cells;
+    block.ping_pong = ping_pong;
+    int index = map.moving_blocks.size();
+    map.moving_blocks.push_back(block);
+    claim(map, x, y, index, changed);
+    claim(map, x + dx, y + dy, index, changed);
+    return true;
+}
+
+void updateMovingBlocks(Map& map, float dt, std::vector<CellEdit>* changed) {
+    for (int i=0; i<(int)map.moving_blocks.size();) {
+        if (advance(map, i, dt, changed)) {
+            i++;
+            continue;
+        }
+        // the last block takes the stopped one's place, its cells have to follow
+        MovingBlock& last = map.moving_blocks.back();
+        if (i != (int)map.moving_blocks.size()-1) {
+            map.moving_blocks[i] = last;
+            for (int step=0; step<2; step++) {
+                auto it = map.moving_cells.find((last.y + step*last.dy)*map.width + last.x + step*last.dx);
+                if (it != map.moving_cells.end()) it->second = i;
+            }
+        }
+        map.moving_blocks.pop_back();
+    }
+}
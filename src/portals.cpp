@@ -0,0 +1,71 @@
+#include "../include/portals.h"
+#include "../include/raycast.h"
+
+#include <cmath>
+
+namespace {
+
+glm::vec2 faceCentre(const Map& map, int cell, int side) {
+    glm::vec2 centre(cell % map.width + 0.5f, cell / map.width + 0.5f);
+    return centre + 0.5f*glm::vec2(face_normal_x[side], face_normal_y[side]);
+}
+
+PortalLink makeLink(const Map& map, int from_cell, int from_side, int to_cell, int to_side) {
+    PortalLink link;
+    link.to_cell = to_cell;
+    link.to_side = to_side;
+    link.from_centre = faceCentre(map, from_cell, from_side);
+    link.to_centre = faceCentre(map, to_cell, to_side);
+    link.to_normal = glm::vec2(face_normal_x[to_side], face_normal_y[to_side]);
+    // whatever goes into the entry face against its normal has to leave along the exit
+    // normal, so the turn is the one taking the entry normal onto minus the exit one
+    glm::vec2 in(face_normal_x[from_side], face_normal_y[from_side]);
+    for (int turns=0; turns<4; turns++) {
+        float c = std::round(std::cos(turns*1.5707963f));
+        float s = std::round(std::sin(turns*1.5707963f));
+        glm::mat2 rotation(c, s, -s, c);
+        if (glm::dot(rotation*in, -link.to_normal) > 0.5f) {
+            link.turns = turns;
+            link.rotation = rotation;
+            break;
+        }
+    }
+    return link;
+}
+
+}
+
+bool linkPortal(Map& map, const Portal& portal) {
+    auto inside = [&](int x, int y) { return x >= 0 && x < map.width && y >= 0 && y < map.height; };
+    if (!inside(portal.x, portal.y) || !inside(portal.to_x, portal.to_y)) return false;
+    int from_cell = portal.y*map.width + portal.x;
+    int to_cell = portal.to_y*map.width + portal.to_x;
+    map.portals[from_cell*4 + portal.side] = makeLink(map, from_cell, portal.side, to_cell, portal.to_side);
+    if (portal.two_way) map.portals[to_cell*4 + portal.to_side] = makeLink(map, to_cell, portal.to_side, from_cell, portal.side);
+    return true;
+}
+
+bool crossPortal(const Map& map, glm::vec2 from, glm::vec2& to, float& angle) {
+    if (map.portals.empty()) return false;
+    int ox = (int)std::floor(from.x);
+    int oy = (int)std::floor(from.y);
+    int nx = (int)std::floor(to.x);
+    int ny = (int)std::floor(to.y);
+    if (ox == nx && oy == ny) return false;
+
+    // a frame's step is well under a cell, so the crossing is into the x neighbour, the
+    // y one, or on a diagonal one of those two first
+    auto through = [&](int x, int y, int side) -> const PortalLink* {
+        if (x < 0 || x >= map.width || y < 0 || y >= map.height) return nullptr;
+        auto link = map.portals.find((y*map.width + x)*4 + side);
+        return link == map.portals.end() ? nullptr : &link->second;
+    };
+    const PortalLink* link = nullptr;
+    if (nx != ox) link = through(nx, oy, nx > ox ? 0 : 2);
+    if (!link && ny != oy) link = through(ox, ny, ny > oy ? 3 : 1);
+    if (!link) return false;
+
+    to = link->point(to);
+    angle += link->turns*1.5707963f;
+    return true;
+}
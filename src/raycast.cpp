@@ -0,0 +1,577 @@
+#include "../include/raycast.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Grid traversal state, one step() per cell boundary crossed
+struct Dda {
+    int grid_x, grid_y;
+    int grid_step_x, grid_step_y;
+    float dist_x, dist_y;
+    float step_x, step_y;
+    int side = 0;
+
+    Dda(glm::vec2 start_pos, glm::vec2 ray_dir) {
+        float ray_x = start_pos.x;
+        float ray_y = start_pos.y;
+        grid_x = int(ray_x);
+        grid_y = int(ray_y);
+        step_x = (ray_dir.x == 0) ? 9999.0f : std::abs(1.0f/ray_dir.x);
+        step_y = (ray_dir.y == 0) ? 9999.0f : std::abs(1.0f/ray_dir.y);
+        // Step calculations
+        if (ray_dir.x < 0) {
+            grid_step_x = -1;
+            dist_x = (ray_x - grid_x) * step_x;
+        }
+        else  {
+            grid_step_x = 1;
+            dist_x = (grid_x + 1.0 - ray_x) * step_x;
+        }
+        if (ray_dir.y < 0) {
+            grid_step_y = -1;
+            dist_y = (ray_y - grid_y) * step_y;
+        }
+        else  {
+            grid_step_y = 1;
+            dist_y  = (grid_y + 1.0 - ray_y) * step_y;
+        }
+    }
+
+    void step() {
+        if (dist_x < dist_y) {
+            dist_x += step_x;
+            grid_x += grid_step_x;
+            side = 0;
+        }
+        else {
+            dist_y += step_y;
+            grid_y += grid_step_y;
+            side = 1;
+        }
+    }
+
+    bool inside(const Map& map) const {
+        return grid_x >= 0 && grid_x < map.width && grid_y >= 0 && grid_y < map.height;
+    }
+
+    // distance to the face of the cell just stepped into
+    float dist() const {
+        return side == 0 ? dist_x - step_x : dist_y - step_y;
+    }
+
+    // distance to where the ray leaves it again
+    float exitDist() const {
+        return std::min(dist_x, dist_y);
+    }
+};
+
+// Fills hit for the face of the cell the DDA just stepped into, grid_val 0 for none
+void faceHit(const Map& map, glm::vec2 start_pos, glm::vec2 ray_dir, const Dda& dda, int grid_val, RayHit& hit) {
+    float wall_height = map.manifest.wall_height;
+    hit.dist = dda.dist();
+    float perpDist;
+    if (dda.side == 0)
+        perpDist = (dda.grid_x - start_pos.x + (1 - dda.grid_step_x) * 0.5f) / ray_dir.x;
+    else
+        perpDist = (dda.grid_y - start_pos.y + (1 - dda.grid_step_y) * 0.5f) / ray_dir.y;
+
+    if (dda.side == 0) {
+        float wall_y = start_pos.y + perpDist * ray_dir.y;
+        hit.tex_x = std::fmod(wall_y, wall_height);
+        hit.face_u = std::clamp(wall_y - dda.grid_y, 0.0f, 1.0f);
+        hit.side = (dda.grid_step_x == 1) ? 0 : 2;
+    }
+    else {
+        float wall_x = start_pos.x + perpDist * ray_dir.x;
+        hit.tex_x = std::fmod(wall_x, wall_height);
+        hit.face_u = std::clamp(wall_x - dda.grid_x, 0.0f, 1.0f);
+        hit.side = (dda.grid_step_y == 1) ? 3 : 1;
+    }
+    if (grid_val == 0) {
+        hit.cell = -1;
+        hit.tex = 0;
+        hit.flags = 0;
+        return;
+    }
+    // single indexed load, the cell's rotation is already folded into the table
+    hit.cell = dda.grid_y*map.width + dda.grid_x;
+    hit.tex = map.materials.face_tex[grid_val*4 + hit.side];
+    hit.flags = map.materials.flags[grid_val];
+}
+
+// Intersects the shape of the cell the DDA just stepped into, between where the ray
+// enters it and where it leaves. Returns false when the ray passes it by.
+bool shapeHit(const Map& map, glm::vec2 start_pos, glm::vec2 ray_dir, const Dda& dda, int grid_val, RayHit& hit) {
+    float param = map.materials.shape_param[grid_val];
+    int rotation = grid_val & 3;
+    glm::vec2 cell_pos(dda.grid_x, dda.grid_y);
+    glm::vec2 local = start_pos - cell_pos;     // the ray from the cell's corner
+    float t_in = dda.dist();
+    float t_out = dda.exitDist();
+    float t;
+    float along;                                // world units along the surface, for tex_x
+    float face_u;                               // 0-1 across the cell
+    int side;
+    switch (map.materials.shape[grid_val]) {
+    case SHAPE_THIN:
+    case SHAPE_DOOR: {
+        // x = c for rotations 0 and 2, y = c for 1 and 3
+        int axis = rotation & 1;
+        bool door = map.materials.shape[grid_val] == SHAPE_DOOR;
+        float c = door ? 0.5f : (rotation >= 2 ? 1.0f - param : param);
+        if (ray_dir[axis] == 0) return false;
+        t = (c - local[axis]) / ray_dir[axis];
+        if (t < t_in || t > t_out) return false;
+        along = local[1-axis] + t*ray_dir[1-axis];
+        face_u = along;
+        if (door) {
+            // the panel slides into the wall on one side, the texture goes with it
+            if (rotation < 2) {
+                if (along < param) return false;
+                along -= param;
+            }
+            else {
+                if (along > 1.0f - param) return false;
+                along += param;
+            }
+        }
+        along += cell_pos[1-axis];
+        if (axis == 0) side = ray_dir.x > 0 ? 0 : 2;
+        else side = ray_dir.y > 0 ? 3 : 1;
+        break;
+    }
+    case SHAPE_DIAGONAL: {
+        // x - y = 0 for rotations 0 and 2, x + y - 1 = 0 for 1 and 3
+        bool anti = rotation & 1;
+        float f = anti ? local.x + local.y - 1.0f : local.x - local.y;
+        float df = anti ? ray_dir.x + ray_dir.y : ray_dir.x - ray_dir.y;
+        if (df == 0) return false;
+        t = -f / df;
+        if (t < t_in || t > t_out) return false;
+        face_u = local.x + t*ray_dir.x;
+        along = cell_pos.x + face_u;
+        if (anti) side = f > 0 ? 1 : 3;
+        else side = f > 0 ? 2 : 0;
+        break;
+    }
+    case SHAPE_PILLAR: {
+        glm::vec2 centre = local - 0.5f;
+        float a = glm::dot(ray_dir, ray_dir);
+        float b = glm::dot(centre, ray_dir);
+        float c = glm::dot(centre, centre) - param*param;
+        float disc = b*b - a*c;
+        if (disc < 0) return false;
+        t = (-b - std::sqrt(disc)) / a;
+        if (t < t_in || t > t_out) return false;
+        glm::vec2 normal = centre + t*ray_dir;
+        // once round, at the same texel size as the walls
+        float angle = std::atan2(normal.y, normal.x) + 3.14159265f;
+        along = angle * param;
+        face_u = angle / 6.2831853f;
+        if (std::abs(normal.x) > std::abs(normal.y)) side = normal.x < 0 ? 0 : 2;
+        else side = normal.y < 0 ? 3 : 1;
+        break;
+    }
+    default:
+        return false;
+    }
+    hit.dist = t;
+    hit.tex_x = std::fmod(along, map.manifest.wall_height);
+    hit.face_u = std::clamp(face_u, 0.0f, 1.0f);
+    hit.side = side;
+    hit.cell = dda.grid_y*map.width + dda.grid_x;
+    hit.tex = map.materials.face_tex[grid_val*4 + side];
+    hit.flags = map.materials.flags[grid_val];
+    return true;
+}
+
+// The block covering a moving_cell cell, null if the table has lost track of it
+const MovingBlock* movingBlock(const Map& map, int cell) {
+    auto it = map.moving_cells.find(cell);
+    return it == map.moving_cells.end() ? nullptr : &map.moving_blocks[it->second];
+}
+
+// Ray against the unit box of a moving block. The box straddles two flagged cells, the
+// hit counts in whichever of them the ray is passing through when it meets the box.
+bool movingHit(const Map& map, glm::vec2 start_pos, glm::vec2 ray_dir, const Dda& dda, const MovingBlock& block,
+               RayHit& hit) {
+    glm::vec2 slide(block.dx*block.offset, block.dy*block.offset);
+    glm::vec2 box_min = glm::vec2(block.x, block.y) + slide;
+    float t_enter = -1e30f;
+    float t_exit = 1e30f;
+    int axis = 0;
+    for (int a=0; a<2; a++) {
+        if (ray_dir[a] == 0) {
+            if (start_pos[a] < box_min[a] || start_pos[a] > box_min[a] + 1.0f) return false;
+            continue;
+        }
+        float t0 = (box_min[a] - start_pos[a]) / ray_dir[a];
+        float t1 = (box_min[a] + 1.0f - start_pos[a]) / ray_dir[a];
+        if (t0 > t1) std::swap(t0, t1);
+        if (t0 > t_enter) {
+            t_enter = t0;
+            axis = a;
+        }
+        t_exit = std::min(t_exit, t1);
+    }
+    // overlap rather than t_enter inside the cell, so a box flush with the cell edge
+    // can't slip between two cells on rounding
+    if (t_enter > t_exit || t_enter > dda.exitDist() || t_exit < dda.dist()) return false;
+
+    hit.dist = t_enter;
+    // the texture travels with the block
+    float along = start_pos[1-axis] + t_enter*ray_dir[1-axis] - slide[1-axis];
+    hit.tex_x = std::fmod(along, map.manifest.wall_height);
+    float cell_start = axis == 0 ? dda.grid_y : dda.grid_x;
+    hit.face_u = std::clamp(start_pos[1-axis] + t_enter*ray_dir[1-axis] - cell_start, 0.0f, 1.0f);
+    if (axis == 0) hit.side = ray_dir.x > 0 ? 0 : 2;
+    else hit.side = ray_dir.y > 0 ? 3 : 1;
+    hit.cell = dda.grid_y*map.width + dda.grid_x;
+    hit.tex = map.materials.face_tex[block.value*4 + hit.side];
+    hit.flags = map.materials.flags[block.value];
+    return true;
+}
+
+// The link of the block face the DDA just stepped into, null if it isn't a portal
+const PortalLink* portalFace(const Map& map, const Dda& dda) {
+    if (map.portals.empty()) return nullptr;
+    int side = dda.side == 0 ? (dda.grid_step_x == 1 ? 0 : 2) : (dda.grid_step_y == 1 ? 3 : 1);
+    auto it = map.portals.find((dda.grid_y*map.width + dda.grid_x)*4 + side);
+    return it == map.portals.end() ? nullptr : &it->second;
+}
+
+// A hit found on the part of a ray after `travelled` worth of portals, in terms of the
+// whole ray
+void finishHit(glm::vec2 start_pos, glm::vec2 ray_dir, float travelled, int hops, RayHit& hit) {
+    hit.pos = start_pos + ray_dir*hit.dist;
+    hit.dir = ray_dir;
+    hit.dist += travelled;
+    hit.portal_hops = hops;
+}
+
+// Screen space (ndc y) parts of one column nearer walls already cover, sorted and
+// disjoint. Only an optimisation on top of the depth test: when it runs out of room
+// new spans just aren't recorded, which costs overdraw but is never wrong.
+struct Coverage {
+    static const int capacity = 16;
+    float lo[capacity];
+    float hi[capacity];
+    int count = 0;
+
+    bool covers(float a, float b) const {
+        for (int i=0; i<count; i++) {
+            if (lo[i] <= a && hi[i] >= b) return true;
+        }
+        return false;
+    }
+
+    // calls visible(from, to) for every piece of [a, b] nothing covers yet
+    template <typename Visible>
+    void clip(float a, float b, Visible visible) const {
+        float cur = a;
+        for (int i=0; i<count && cur < b; i++) {
+            if (hi[i] <= cur) continue;
+            if (lo[i] >= b) break;
+            if (lo[i] > cur) visible(cur, lo[i]);
+            cur = std::max(cur, hi[i]);
+        }
+        if (cur < b) visible(cur, b);
+    }
+
+    void add(float a, float b) {
+        // everything [a, b] touches merges into one interval at the first one it touches
+        int first = 0;
+        while (first < count && hi[first] < a) first++;
+        int last = first;
+        while (last < count && lo[last] <= b) {
+            a = std::min(a, lo[last]);
+            b = std::max(b, hi[last]);
+            last++;
+        }
+        int removed = last - first;
+        if (removed == 0 && count == capacity) return;
+        int shift = 1 - removed;
+        if (shift > 0) {
+            for (int i=count-1; i>=last; i--) { lo[i+shift] = lo[i]; hi[i+shift] = hi[i]; }
+        }
+        else if (shift < 0) {
+            for (int i=last; i<count; i++) { lo[i+shift] = lo[i]; hi[i+shift] = hi[i]; }
+        }
+        lo[first] = a;
+        hi[first] = b;
+        count += shift;
+    }
+};
+
+}
+
+bool castRay(const Map& map, glm::vec2 start_pos, glm::vec2 ray_dir, RayHit& hit, float max_dist) {
+    const int* grid = map.grid.data();
+    const uint8_t* shapes = map.materials.shape.data();
+    Dda dda(start_pos, ray_dir);
+    float travelled = 0.0f;     // up to start_pos, which moves on at every portal
+    int hops = 0;
+    // DDA
+    while (true) {
+        dda.step();
+        if (!dda.inside(map) || travelled + dda.dist() > max_dist) break;
+        int grid_val = grid[dda.grid_y*map.width + dda.grid_x];
+        if (grid_val == 0) continue;
+        if (grid_val == moving_cell) {
+            const MovingBlock* block = movingBlock(map, dda.grid_y*map.width + dda.grid_x);
+            if (block && movingHit(map, start_pos, ray_dir, dda, *block, hit)) {
+                finishHit(start_pos, ray_dir, travelled, hops, hit);
+                return true;
+            }
+            continue;
+        }
+        // blocks are hit on the face the ray came in through, other shapes can let it by
+        if (shapes[grid_val] == SHAPE_BLOCK) {
+            const PortalLink* portal = hops < max_portal_hops ? portalFace(map, dda) : nullptr;
+            if (portal) {
+                travelled += dda.dist();
+                start_pos = portal->point(start_pos + ray_dir*dda.dist());
+                ray_dir = portal->direction(ray_dir);
+                dda = Dda(start_pos, ray_dir);
+                hops++;
+                continue;
+            }
+            faceHit(map, start_pos, ray_dir, dda, grid_val, hit);
+            finishHit(start_pos, ray_dir, travelled, hops, hit);
+            return true;
+        }
+        if (shapeHit(map, start_pos, ray_dir, dda, grid_val, hit)) {
+            finishHit(start_pos, ray_dir, travelled, hops, hit);
+            return true;
+        }
+    }
+    faceHit(map, start_pos, ray_dir, dda, 0, hit);
+    finishHit(start_pos, ray_dir, travelled, hops, hit);
+    return false;
+}
+
+bool castRayBlocks(const Map& map, glm::vec2 start_pos, glm::vec2 ray_dir, RayHit& hit) {
+    const int* grid = map.grid.data();
+    Dda dda(start_pos, ray_dir);
+    int grid_val = 0;
+    while (true) {
+        dda.step();
+        if (!dda.inside(map)) {
+            grid_val = 0;
+            break;
+        }
+        grid_val = grid[dda.grid_y*map.width + dda.grid_x];
+        if (grid_val != 0) break;
+    }
+    faceHit(map, start_pos, ray_dir, dda, grid_val, hit);
+    finishHit(start_pos, ray_dir, 0.0f, 0, hit);
+    return grid_val != 0;
+}
+
+bool castSpans(const Map& map, glm::vec2 start_pos, glm::vec2 ray_dir, float view_cos, float proj_scale,
+               const SpanBudget& budget, std::vector<WallSpan>& spans, std::vector<WallSpan>& see_through,
+               float& covered_depth) {
+    float wall_height = map.manifest.wall_height;
+    float eye = wall_height*0.5f;           // the columns are drawn symmetric about the horizon
+    float proj = std::abs(proj_scale);
+    int layer_count = 1 + map.stacked_grids.size();
+    int opaque = 0;
+    int clear = 0;
+    Coverage coverage;
+    Dda dda(start_pos, ray_dir);
+    covered_depth = 1e30f;
+    float far_depth = 0.0f;     // of the farthest opaque wall drawn so far
+    float travelled = 0.0f;     // up to start_pos, which moves on at every portal
+    int hops = 0;
+
+    while (opaque < budget.spans) {
+        dda.step();
+        if (!dda.inside(map)) break;
+        float dist = travelled + dda.dist();
+        float depth = dist * view_cos;
+        if (dist > budget.max_dist) {
+            covered_depth = budget.max_dist * view_cos;
+            return true;
+        }
+        // ndc per world unit of height at this depth, the largest anything farther gets
+        float scale = 2.0f*proj / depth;
+        float target_lo = std::max(-1.0f, -eye*scale);
+        float target_hi = std::min(1.0f, (map.wall_top - eye)*scale);
+        if (target_lo >= target_hi) {
+            covered_depth = depth;
+            return true;
+        }
+
+        int cell = dda.grid_y*map.width + dda.grid_x;
+        const PortalLink* portal = nullptr;
+        for (int layer=0; layer<layer_count; layer++) {
+            int grid_val = layer == 0 ? map.grid[cell] : map.stacked_grids[layer-1][cell];
+            if (grid_val == 0) continue;
+            const MovingBlock* mover = nullptr;
+            if (grid_val == moving_cell) {
+                mover = movingBlock(map, cell);
+                if (!mover) continue;
+                grid_val = mover->value;
+            }
+            bool transparent = map.materials.flags[grid_val] & MAT_TRANSPARENT;
+            if (transparent && clear >= budget.see_through) continue;
+            // shapes inside the cell sit farther in than the face the ray entered by
+            RayHit hit;
+            bool block = !mover && map.materials.shape[grid_val] == SHAPE_BLOCK;
+            if (block && layer == 0 && hops < budget.portal_hops && (portal = portalFace(map, dda))) continue;
+            float hit_scale = scale;
+            if (!block) {
+                bool found = mover ? movingHit(map, start_pos, ray_dir, dda, *mover, hit)
+                                   : shapeHit(map, start_pos, ray_dir, dda, grid_val, hit);
+                if (!found) continue;
+                finishHit(start_pos, ray_dir, travelled, hops, hit);
+                hit_scale = 2.0f*proj / (hit.dist*view_cos);
+            }
+            float base = layer*wall_height;
+            float height = map.materials.height[grid_val]*wall_height;
+            float lo = std::max((base - eye)*hit_scale, -1.0f);
+            float hi = std::min((base + height - eye)*hit_scale, 1.0f);
+            if (lo >= hi) continue;
+            if (block) {
+                faceHit(map, start_pos, ray_dir, dda, grid_val, hit);
+                finishHit(start_pos, ray_dir, travelled, hops, hit);
+            }
+
+            std::vector<WallSpan>& out = transparent ? see_through : spans;
+            // ndc back to the column line's units and to the height up the wall
+            float to_units = 2.0f / (wall_height*hit_scale);
+            coverage.clip(lo, hi, [&](float from, float to) {
+                WallSpan span;
+                span.hit = hit;
+                span.layer = layer;
+                span.bottom = from * to_units;
+                span.top = to * to_units;
+                span.v_bottom = (eye + from/hit_scale - base) / height;
+                span.v_top = (eye + to/hit_scale - base) / height;
+                out.push_back(span);
+                if (transparent) clear++;
+                else opaque++;
+            });
+            if (!transparent) {
+                coverage.add(lo, hi);
+                far_depth = std::max(far_depth, hit.dist*view_cos);
+            }
+        }
+        if (coverage.covers(target_lo, target_hi)) {
+            covered_depth = std::max(depth, far_depth);
+            return true;
+        }
+        if (portal) {
+            // on from the exit face; the path through is as long as it looks, so the
+            // distances, depths and coverage carry straight on
+            travelled = dist;
+            start_pos = portal->point(start_pos + ray_dir*dda.dist());
+            ray_dir = portal->direction(ray_dir);
+            dda = Dda(start_pos, ray_dir);
+            hops++;
+        }
+    }
+    return false;
+}
+
+int reflectSpans(const Map& map, std::vector<WallSpan>& spans, size_t first, float max_dist, ReflectionBudget& budget) {
+    // cell value a hit came from, the block's own for a moving one
+    auto valueOf = [&](const RayHit& hit) {
+        int value = map.grid[hit.cell];
+        if (value != moving_cell) return value;
+        const MovingBlock* block = movingBlock(map, hit.cell);
+        return block ? block->value : 0;
+    };
+    auto mirrorFace = [&](const RayHit& hit) {
+        if (!(hit.flags & MAT_MIRROR) || hit.cell < 0) return false;
+        int value = valueOf(hit);
+        return value > 0 && map.materials.shape[value] == SHAPE_BLOCK;
+    };
+
+    int cast = 0;
+    size_t end = spans.size();
+    for (size_t i=first; i<end; i++) {
+        const WallSpan mirror = spans[i];
+        if (mirror.layer != 0 || !mirrorFace(mirror.hit) || budget.rays <= 0) continue;
+        glm::vec2 dir = mirror.hit.dir;
+        glm::vec2 point = mirror.hit.pos;
+        float travelled = mirror.hit.dist;
+        RayHit hit = mirror.hit;
+        bool found = false;
+        for (int bounce=0; bounce<budget.bounces && budget.rays > 0 && mirrorFace(hit); bounce++) {
+            // west and east faces turn the ray round along x, north and south along y
+            if (hit.side == 0 || hit.side == 2) dir.x = -dir.x;
+            else dir.y = -dir.y;
+            budget.rays--;
+            budget.used++;
+            cast++;
+            // a hair off the face, so the DDA starts in the open cell in front of it
+            glm::vec2 from = point + dir*1e-4f;
+            RayHit next;
+            if (!castRay(map, from, dir, next, max_dist - travelled)) {
+                found = false;
+                break;
+            }
+            point = next.pos;
+            dir = next.dir;
+            travelled += next.dist + 1e-4f;
+            hit = next;
+            found = true;
+        }
+        if (!found) continue;
+
+        // column units (half wall heights from the eye) at the mirror to the same screen
+        // height at the end of the path, the height projects as 1/distance
+        float to_far = travelled / mirror.hit.dist;
+        float height = map.materials.height[valueOf(hit)];
+        float lo = std::max(-1.0f, mirror.bottom*to_far);
+        float hi = std::min(2.0f*height - 1.0f, mirror.top*to_far);
+        if (lo >= hi) continue;
+        WallSpan reflected;
+        reflected.hit = hit;
+        reflected.hit.dist = travelled;
+        reflected.layer = 0;
+        reflected.bottom = lo;
+        reflected.top = hi;
+        reflected.v_bottom = (lo + 1.0f) / (2.0f*height);
+        reflected.v_top = (hi + 1.0f) / (2.0f*height);
+        spans[i] = reflected;
+
+        // the mirror's own face where the reflection leaves it showing
+        auto mirrorPart = [&](float bottom, float top) {
+            WallSpan part = mirror;
+            float v_per_unit = (mirror.v_top - mirror.v_bottom) / (mirror.top - mirror.bottom);
+            part.bottom = bottom;
+            part.top = top;
+            part.v_bottom = mirror.v_bottom + (bottom - mirror.bottom)*v_per_unit;
+            part.v_top = mirror.v_bottom + (top - mirror.bottom)*v_per_unit;
+            spans.push_back(part);
+        };
+        if (lo/to_far > mirror.bottom) mirrorPart(mirror.bottom, lo/to_far);
+        if (hi/to_far < mirror.top) mirrorPart(hi/to_far, mirror.top);
+    }
+    return cast;
+}
+
+bool interpolateSpan(const Map& map, const WallSpan& left, const WallSpan& right, float min_dist, WallSpan& out) {
+    const RayHit& a = left.hit;
+    const RayHit& b = right.hit;
+    if (a.cell < 0 || a.cell != b.cell || a.side != b.side || left.layer != right.layer || left.layer != 0) return false;
+    if (a.portal_hops != b.portal_hops) return false;
+    if (min_dist <= 0.0f || a.dist < min_dist || b.dist < min_dist || a.tex != b.tex) return false;
+    // only plain blocks, anything thinner could sit between the two rays; one face is a
+    // cell wide, so tex_x further apart than that wrapped round in between
+    int value = map.grid[a.cell];
+    if (value <= 0 || map.materials.shape[value] != SHAPE_BLOCK || std::abs(a.tex_x - b.tex_x) > 1.0f) return false;
+    out = left;
+    out.hit.dist = (a.dist + b.dist)*0.5f;
+    out.hit.tex_x = (a.tex_x + b.tex_x)*0.5f;
+    out.hit.face_u = (a.face_u + b.face_u)*0.5f;
+    out.bottom = (left.bottom + right.bottom)*0.5f;
+    out.top = (left.top + right.top)*0.5f;
+    out.v_bottom = (left.v_bottom + right.v_bottom)*0.5f;
+    out.v_top = (left.v_top + right.v_top)*0.5f;
+    return true;
+}
@@ -0,0 +1,208 @@
+#include "../include/security_cameras.h"
+#include "../include/light_grid.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace {
+
+const int line_stride = 9;      // same vertices as the column pass: pos, texture, uv, light
+
+const float quad[] = {
+    -1.0f, 1.0f, 0.0f,
+     1.0f, 1.0f, 0.0f,
+    -1.0f,-1.0f, 0.0f,
+
+    -1.0f,-1.0f, 0.0f,
+     1.0f, 1.0f, 0.0f,
+     1.0f,-1.0f, 0.0f
+};
+
+}
+
+void SecurityCameras::create() {
+    glGenFramebuffers(1, &framebuffer);
+    glGenRenderbuffers(1, &depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, camera_view_size, camera_view_size);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    glGenVertexArrays(1, &lines_vao);
+    glGenBuffers(1, &lines_vbo);
+    glBindVertexArray(lines_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, lines_vbo);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, line_stride*sizeof(float), (void*)0);
+    glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, line_stride*sizeof(float), (void*)(3*sizeof(float)));
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, line_stride*sizeof(float), (void*)(4*sizeof(float)));
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, line_stride*sizeof(float), (void*)(6*sizeof(float)));
+    for (int i=0; i<4; i++) glEnableVertexAttribArray(i);
+
+    glGenVertexArrays(1, &quad_vao);
+    glGenBuffers(1, &quad_vbo);
+    glBindVertexArray(quad_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, quad_vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3*sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+}
+
+void SecurityCameras::release() {
+    glDeleteTextures(1, &texture);
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(1, &depth);
+    glDeleteVertexArrays(1, &lines_vao);
+    glDeleteBuffers(1, &lines_vbo);
+    glDeleteVertexArrays(1, &quad_vao);
+    glDeleteBuffers(1, &quad_vbo);
+    texture = framebuffer = depth = lines_vao = lines_vbo = quad_vao = quad_vbo = 0;
+    lines_capacity = 0;
+    views.clear();
+}
+
+void SecurityCameras::reset(const Map& map) {
+    glDeleteTextures(1, &texture);
+    texture = 0;
+    views.assign(map.manifest.cameras.size(), View());
+    if (views.empty()) return;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RGBA8, camera_view_size, camera_view_size, views.size());
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    // black until a camera is first looked at
+    const unsigned char black[] = {0, 0, 0, 255};
+    glClearTexImage(texture, 0, GL_RGBA, GL_UNSIGNED_BYTE, black);
+}
+
+int SecurityCameras::cameraOf(const Map& map, const WallSpan& span) const {
+    const RayHit& hit = span.hit;
+    if (!(hit.flags & MAT_MONITOR) || hit.cell < 0) return -1;
+    int value = span.layer == 0 ? map.grid[hit.cell] : map.stacked_grids[span.layer-1][hit.cell];
+    if (value == moving_cell) {
+        auto it = map.moving_cells.find(hit.cell);
+        if (it == map.moving_cells.end()) return -1;
+        value = map.moving_blocks[it->second].value;
+    }
+    int material = value/4;
+    if (material < 0 || material >= (int)map.manifest.material_cameras.size()) return -1;
+    int camera = map.manifest.material_cameras[material];
+    return camera >= 0 && camera < (int)views.size() ? camera : -1;
+}
+
+void SecurityCameras::addCoverage(int camera, float pixels) {
+    if (camera >= 0 && camera < (int)views.size()) views[camera].coverage += pixels;
+}
+
+int SecurityCameras::refresh(const Map& map, const LightGrid& lights, Shader& column_shader,
+                             Shader& floor_shader, const CameraBuffer& camera, float time, int count) {
+    if (views.empty()) return 0;
+    auto start = std::chrono::steady_clock::now();
+    // only cameras someone is looking at, the ones covering the most pixels the longest
+    // time ago first
+    order.clear();
+    for (int i=0; i<(int)views.size(); i++) {
+        views[i].age++;
+        if (views[i].coverage > 0.0f) order.push_back(i);
+    }
+    auto priority = [&](int i) { return views[i].coverage * views[i].age; };
+    std::sort(order.begin(), order.end(), [&](int a, int b) { return priority(a) > priority(b); });
+    if ((int)order.size() > count) order.resize(count);
+    for (View& view : views) view.coverage = 0.0f;
+    if (order.empty()) return 0;
+
+    const MapManifest& manifest = map.manifest;
+    float wall_height = manifest.wall_height;
+    SpanBudget budget;
+    budget.see_through = 0;
+    budget.max_dist = manifest.maxDist();
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(0, 0, camera_view_size, camera_view_size);
+    // the views can't show up in the views they are being drawn into
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glClearColor(manifest.fog_colour.r, manifest.fog_colour.g, manifest.fog_colour.b, 1.0f);
+    for (int index : order) {
+        const SecurityCamera& view = manifest.cameras[index];
+        glm::vec2 dir(std::cos(view.ang), std::sin(view.ang));
+        glm::vec2 plane = glm::vec2(-dir.y, dir.x) * std::tan(view.fov*0.5f);
+        // square, so the vertical field of view is the horizontal one
+        float proj_scale = 1.0f / (2.0f*std::tan(view.fov*0.5f));
+
+        lines.clear();
+        ReflectionBudget reflections;
+        reflections.rays = camera_view_size;
+        for (int c=0; c<camera_view_size; c++) {
+            float camera_x = 2.0f * c / float(camera_view_size) - 1.0f;
+            glm::vec2 ray_dir = glm::normalize(dir + plane*camera_x);
+            float view_cos = glm::dot(ray_dir, dir);
+            spans.clear();
+            see_through.clear();
+            float covered_depth;
+            castSpans(map, view.pos, ray_dir, view_cos, proj_scale, budget, spans, see_through, covered_depth);
+            reflectSpans(map, spans, 0, budget.max_dist, reflections);
+            for (const WallSpan& span : spans) {
+                const RayHit& hit = span.hit;
+                // emissive faces at full brightness, like the main view
+                glm::vec3 light(1.0f);
+                if (!(hit.flags & MAT_EMISSIVE)) {
+                    light = map.lightmap.sample(hit.cell, hit.side, hit.face_u, glm::vec3(manifest.ambient));
+                    light += lights.faceLight(map, hit);
+                }
+                float top[] = {camera_x, span.top, hit.dist, (float)hit.tex, hit.tex_x/wall_height, span.v_top,
+                               light.r, light.g, light.b};
+                float bottom[] = {camera_x, span.bottom, hit.dist, (float)hit.tex, hit.tex_x/wall_height, span.v_bottom,
+                                  light.r, light.g, light.b};
+                lines.insert(lines.end(), top, top + line_stride);
+                lines.insert(lines.end(), bottom, bottom + line_stride);
+            }
+        }
+
+        CameraUniforms uniforms;
+        uniforms.pos_dir = glm::vec4(view.pos, dir);
+        uniforms.plane = glm::vec4(plane, 0.5f*wall_height, wall_height);
+        uniforms.screen = glm::vec4(camera_view_size, camera_view_size, proj_scale, time);
+        uniforms.fog = glm::vec4(manifest.fog_colour, manifest.fogDensity());
+        uniforms.view = glm::vec4(manifest.maxDist(), manifest.fog_start, manifest.lod_distance, 0.0f);
+        camera.update(uniforms);
+
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture, 0, index);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        column_shader.use();
+        glBindBuffer(GL_ARRAY_BUFFER, lines_vbo);
+        if (lines.size() > lines_capacity) {
+            lines_capacity = lines.size() * 2;
+            glBufferData(GL_ARRAY_BUFFER, lines_capacity*sizeof(float), NULL, GL_STREAM_DRAW);
+        }
+        glBufferSubData(GL_ARRAY_BUFFER, 0, lines.size()*sizeof(float), lines.data());
+        glBindVertexArray(lines_vao);
+        glDrawArrays(GL_LINES, 0, lines.size()/line_stride);
+
+        floor_shader.use();
+        glDepthFunc(GL_LEQUAL);
+        glDepthMask(GL_FALSE);
+        glBindVertexArray(quad_vao);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+        glDepthMask(GL_TRUE);
+        glDepthFunc(GL_LESS);
+
+        views[index].age = 0;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    timing.refreshes += order.size();
+    timing.ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return order.size();
+}
+
+void SecurityCameras::bind(int unit) const {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    glActiveTexture(GL_TEXTURE0);
+}
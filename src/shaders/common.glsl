@@ -0,0 +1,54 @@
+// Shared by every shader: Shader puts this right after the #version line of each one
+
+struct TextureRect {
+    vec4 uv;        // offset in xy, size in zw, normalised to the page
+    float page;
+    float pad0, pad1, pad2;
+};
+layout (std430, binding = 0) readonly buffer TextureRects {
+    TextureRect rects[];
+};
+
+layout (std140, binding = 0) uniform Camera {
+    vec4 posDir;        // player position xy, view direction zw
+    vec4 plane;         // camera plane xy, eye level, wall height
+    vec4 screen;        // framebuffer width, height, projection scale, time
+    vec4 fog;           // fog colour rgb, density per world unit past the fog start
+    vec4 view;          // view distance, fog start, lod distance
+} camera;
+
+uniform sampler2DArray texture1;
+
+// Virtual texturing (see virtual_texture.h): texture1 is then the physical page cache,
+// and the tables below say where each page of each level of each texture sits in it
+uniform bool virtualTexturing;
+layout (std430, binding = 1) readonly buffer VirtualTextures {
+    ivec4 vt_textures[];    // level base, level count, width, height
+};
+layout (std430, binding = 2) readonly buffer VirtualLevels {
+    ivec4 vt_levels[];      // page base, pages x, pages y
+};
+layout (std430, binding = 3) readonly buffer VirtualPages {
+    int vt_slots[];         // physical layer of every page, -1 if not resident
+};
+const float vt_page = 128.0f;
+const float vt_border = 1.0f;
+
+// uv is 0-1 across texture tex, wrapped or clamped by the caller. Returns fallback if
+// not even the tail is resident yet.
+vec4 sampleVirtual(vec2 uv, int tex, float lod, vec4 fallback) {
+    ivec4 info = vt_textures[tex];
+    // walk up from the wanted level until a resident page turns up, the tail always is
+    for (int level = clamp(int(lod), 0, info.y-1); level < info.y; level++) {
+        ivec4 lv = vt_levels[info.x + level];
+        vec2 level_size = max(floor(vec2(info.zw) / exp2(float(level))), vec2(1.0f));
+        vec2 texel = uv * level_size;
+        ivec2 page = min(ivec2(texel / vt_page), lv.yz-1);
+        int slot = vt_slots[lv.x + page.y*lv.y + page.x];
+        if (slot >= 0) {
+            vec2 in_page = (texel - vec2(page)*vt_page + vt_border) / (vt_page + 2.0f*vt_border);
+            return textureLod(texture1, vec3(in_page, float(slot)), 0.0f);
+        }
+    }
+    return fallback;
+}
\ No newline at end of file
@@ -0,0 +1,47 @@
+#version 460 core
+out vec4 FragColour;
+in vec2 ndc;
+
+// floor texture in the low 16 bits, ceiling texture in the high ones, see Map::floor_cells
+layout (std430, binding = 4) readonly buffer FloorCells {
+    uint floor_cells[];
+};
+uniform ivec2 mapSize;
+
+void main() {
+    // the eye sits half way up the walls (the columns are symmetric about the horizon),
+    // so every row sees the floor or ceiling plane wall_height/2 away
+    float wall_height = camera.plane.w;
+    float dist = wall_height * abs(camera.screen.z) / max(abs(ndc.y), 1e-4f);
+    vec2 world = camera.posDir.xy + (camera.posDir.zw + camera.plane.xy*ndc.x) * dist;
+    vec2 uv = world / wall_height;
+    // derivatives before anything can discard, fract() would break them at texture seams
+    vec2 dx = dFdx(uv);
+    vec2 dy = dFdy(uv);
+
+    // along the ray like the walls' distance, rows past the view distance are all fog,
+    // which is the clear colour
+    float ray_dist = dist * length(camera.posDir.zw + camera.plane.xy*ndc.x);
+    if (ray_dist > camera.view.x) discard;
+    float bias = camera.view.z > 0.0f ? max(log2(ray_dist / camera.view.z), 0.0f) : 0.0f;
+    float visible = exp(-camera.fog.w * max(ray_dist - camera.view.y, 0.0f));
+
+    ivec2 cell = ivec2(floor(world));
+    if (any(lessThan(cell, ivec2(0))) || any(greaterThanEqual(cell, mapSize))) discard;
+    uint cell_textures = floor_cells[cell.y*mapSize.x + cell.x];
+    uint tex = ndc.y < 0.0f ? (cell_textures & 0xffffu) : (cell_textures >> 16);
+    if (tex == 0xffffu) discard;
+
+    if (virtualTexturing) {
+        vec2 size = vec2(vt_textures[tex].zw);
+        float lod = log2(max(max(length(dx*size), length(dy*size)), 1.0f));
+        FragColour = sampleVirtual(fract(uv), int(tex), lod + bias, vec4(camera.fog.rgb, 1.0f));
+    }
+    else {
+        TextureRect rect = rects[min(int(tex), rects.length()-1)];
+        vec3 coord = vec3(rect.uv.xy + fract(uv)*rect.uv.zw, rect.page);
+        float scale = exp2(bias);
+        FragColour = textureGrad(texture1, coord, dx*rect.uv.zw*scale, dy*rect.uv.zw*scale);
+    }
+    FragColour.rgb = mix(camera.fog.rgb, FragColour.rgb, visible);
+}
\ No newline at end of file
@@ -2,9 +2,28 @@
 out vec4 FragColour;
 in vec3 vColour;
 in vec2 texCoord;
+flat in float texPage;
+in vec3 vLight;
+in float vDist;
+flat in int vCamera;
 
-uniform sampler2D texture1;
+uniform sampler2DArray cameraViews;     // a layer per security camera, on unit 1
 
 void main() {
-	FragColour = texture(texture1, texCoord);
+	// a mip level coarser every time the distance past the lod distance doubles
+	float bias = camera.view.z > 0.0f ? max(log2(vDist / camera.view.z), 0.0f) : 0.0f;
+	if (vCamera >= 0) FragColour = texture(cameraViews, vec3(texCoord, float(vCamera)), bias);
+	else if (virtualTexturing) {
+		// derivatives have to be taken before the branch into the page walk
+		vec2 size = vec2(vt_textures[int(texPage)].zw);
+		vec2 dy = dFdy(texCoord * size);
+		vec2 dx = dFdx(texCoord * size);
+		float lod = log2(max(max(length(dx), length(dy)), 1.0f));
+		FragColour = sampleVirtual(fract(texCoord), int(texPage), lod + bias, vec4(vColour, 1.0f));
+	}
+	else FragColour = texture(texture1, vec3(texCoord, texPage), bias);
+	FragColour.rgb *= vLight;
+	// all but gone at the view distance, where the rays stop
+	float visible = exp(-camera.fog.w * max(vDist - camera.view.y, 0.0f));
+	FragColour.rgb = mix(camera.fog.rgb, FragColour.rgb, visible);
 }
\ No newline at end of file
@@ -0,0 +1,36 @@
+#version 460 core
+out vec4 FragColour;
+in vec2 ndc;
+
+// angle of every column's ray from the view direction, only rebuilt when the field of
+// view or the width changes
+layout (std430, binding = 6) readonly buffer SkyColumns {
+    float sky_angles[];
+};
+uniform int skyTexture;
+uniform float skyRepeats;       // times the texture goes round the whole circle
+uniform float viewAngle;        // radians
+
+void main() {
+    // a cylinder round the player: across by the angle of the column's ray, and from the
+    // top of the screen down to the horizon
+    int column = clamp(int(gl_FragCoord.x), 0, sky_angles.length()-1);
+    float angle = viewAngle + sky_angles[column];
+    vec2 uv = vec2(angle / 6.2831853f * skyRepeats, 1.0f - ndc.y);
+    // before the wrap, so the seam doesn't pick the smallest mip
+    vec2 dx = dFdx(uv);
+    vec2 dy = dFdy(uv);
+
+    if (virtualTexturing) {
+        vec2 size = vec2(vt_textures[skyTexture].zw);
+        float lod = log2(max(max(length(dx*size), length(dy*size)), 1.0f));
+        FragColour = sampleVirtual(fract(uv), skyTexture, lod, vec4(camera.fog.rgb, 1.0f));
+    }
+    else {
+        TextureRect rect = rects[clamp(skyTexture, 0, rects.length()-1)];
+        vec3 coord = vec3(rect.uv.xy + fract(uv)*rect.uv.zw, rect.page);
+        FragColour = textureGrad(texture1, coord, dx*rect.uv.zw, dy*rect.uv.zw);
+    }
+    // the bottom fades into the fog colour the floors leave past the view distance
+    if (camera.fog.w > 0.0f) FragColour.rgb = mix(camera.fog.rgb, FragColour.rgb, smoothstep(0.0f, 0.15f, ndc.y));
+}
\ No newline at end of file
@@ -0,0 +1,31 @@
+#version 460 core
+out vec4 FragColour;
+in vec2 texCoord;
+flat in float texPage;
+flat in int texIndex;
+flat in float depth;
+in float vDist;
+
+// distance to the wall of every framebuffer column, filled in by the ray loop
+layout (std430, binding = 5) readonly buffer ColumnDepth {
+    float column_depth[];
+};
+
+void main() {
+    // sampled before the discards, which would leave the derivatives undefined
+    vec4 colour;
+    float bias = camera.view.z > 0.0f ? max(log2(vDist / camera.view.z), 0.0f) : 0.0f;
+    if (virtualTexturing) {
+        vec2 size = vec2(vt_textures[texIndex].zw);
+        vec2 dx = dFdx(texCoord * size);
+        vec2 dy = dFdy(texCoord * size);
+        float lod = log2(max(max(length(dx), length(dy)), 1.0f));
+        colour = sampleVirtual(clamp(texCoord, 0.0f, 1.0f), texIndex, lod + bias, vec4(0.0f));
+    }
+    else colour = texture(texture1, vec3(texCoord, texPage), bias);
+
+    int column = clamp(int(gl_FragCoord.x), 0, column_depth.length()-1);
+    if (depth >= column_depth[column] || colour.a < 0.5f) discard;
+    colour.rgb = mix(camera.fog.rgb, colour.rgb, exp(-camera.fog.w * max(vDist - camera.view.y, 0.0f)));
+    FragColour = colour;
+}
\ No newline at end of file
@@ -1,17 +1,41 @@
 #version 460 core
 layout (location = 0) in vec3 vPos;
-layout (location = 1) in float texType;
+layout (location = 1) in float texType;    // -1 - camera for a monitor, see security_cameras.h
 layout (location = 2) in vec2 texPos;
+layout (location = 3) in vec3 light;      // from the lightmap, 1 for unlit maps
 
 uniform vec3 aColour;
 out vec3 vColour;
 out vec2 texCoord;
+flat out float texPage;
+out vec3 vLight;
+out float vDist;
+flat out int vCamera;
 
 void main() {
 	float projZ = 1.0f - (1.0f / (vPos.z+1));
-    gl_Position = vec4(vPos.xy, projZ, 1.0f);
+    // vPos.y is the end of the wall span in half wall heights from the eye (+1 and -1 for
+    // a whole wall on the ground), vPos.z the ray distance, which gets the fisheye
+    // correction before it is projected
+    vec2 dir = camera.posDir.zw;
+    vec2 ray_dir = normalize(dir + camera.plane.xy * vPos.x);
+    float corrected_dist = vPos.z * dot(ray_dir, dir);
+    float height = camera.plane.w / corrected_dist * abs(camera.screen.z);
+    gl_Position = vec4(vPos.x, vPos.y*height, projZ, 1.0f);
     vColour = aColour;
 
-    texCoord.x = 0.25f*texPos.x + 0.25f*mod(texType, 4);
-    texCoord.y = 0.25f*texPos.y;// + 0.25f*(texType/4);
+    vCamera = texType < 0.0f ? int(round(-texType)) - 1 : -1;
+    if (vCamera >= 0) {
+        // the views are drawn bottom row first, like the screen
+        texCoord = texPos;
+        texPage = 0.0f;
+    }
+    else {
+        TextureRect rect = rects[clamp(int(texType), 0, rects.length()-1)];
+        // texPos.y runs up the wall, texture rows run down the image
+        texCoord = rect.uv.xy + vec2(texPos.x, 1.0f - texPos.y)*rect.uv.zw;
+        texPage = rect.page;
+    }
+    vLight = light;
+    vDist = vPos.z;
 }
\ No newline at end of file
@@ -0,0 +1,11 @@
+#version 460 core
+layout (location = 0) in vec3 vPos;
+
+out vec2 ndc;
+
+void main() {
+    // full screen quad just short of the far plane, so with GL_LEQUAL only pixels no wall
+    // covered shade, and the depth they write keeps the sky (on the far plane) off them
+    gl_Position = vec4(vPos.xy, 0.999999f, 1.0f);
+    ndc = vPos.xy;
+}
\ No newline at end of file
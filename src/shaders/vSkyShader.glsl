@@ -0,0 +1,13 @@
+#version 460 core
+layout (location = 0) in vec3 vPos;
+
+out vec2 ndc;
+
+void main() {
+    // the full screen quad folded up to the part above the horizon, on the far plane
+    // behind the floors and ceilings too, so with GL_LEQUAL only pixels nothing else
+    // drew shade
+    vec2 pos = vec2(vPos.x, max(vPos.y, 0.0f));
+    gl_Position = vec4(pos, 1.0f, 1.0f);
+    ndc = pos;
+}
\ No newline at end of file
@@ -0,0 +1,33 @@
+#version 460 core
+layout (location = 0) in vec2 corner;       // -0.5 to 0.5 across, 0 to 1 up
+layout (location = 1) in vec4 instance;     // position xy, size, texture
+
+out vec2 texCoord;
+flat out float texPage;
+flat out int texIndex;
+flat out float depth;
+out float vDist;
+
+void main() {
+    vec2 dir = camera.posDir.zw;
+    vec2 plane = camera.plane.xy;
+    vec2 to_sprite = instance.xy - camera.posDir.xy;
+    depth = dot(to_sprite, dir);
+    float camera_x = dot(to_sprite, plane) / dot(plane, plane) / depth;
+    // the same scale as the columns: wall_height world units span 2*wall_height*proj/depth,
+    // with the floor at the bottom of that span
+    float proj = abs(camera.screen.z);
+    float size = instance.z;
+    float x = camera_x + corner.x*size / (length(plane)*depth);
+    float y = (2.0f*corner.y*size - camera.plane.w) * proj / depth;
+    // depth is written like the columns write theirs (from the distance along the ray),
+    // so see-through walls drawn later blend over the sprites behind them only
+    float ray_dist = depth * length(dir + plane*x);
+    gl_Position = vec4(x, y, 1.0f - 1.0f/(ray_dist+1.0f), 1.0f);
+    vDist = ray_dist;
+
+    texIndex = int(instance.w);
+    TextureRect rect = rects[clamp(texIndex, 0, rects.length()-1)];
+    texCoord = rect.uv.xy + vec2(corner.x + 0.5f, 1.0f - corner.y)*rect.uv.zw;
+    texPage = rect.page;
+}
\ No newline at end of file
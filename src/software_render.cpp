@@ -0,0 +1,302 @@
+#include "../include/software_render.h"
+#include "../include/light_grid.h"
+#include "../include/raycast.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double msSince(Clock::time_point& start) {
+    Clock::time_point now = Clock::now();
+    double ms = std::chrono::duration<double, std::milli>(now - start).count();
+    start = now;
+    return ms;
+}
+
+// every layer has to be the same size RGBA8 image for the texel addresses to be shared
+bool usableLayers(const Map& map) {
+    if (!map.texture_per_layer || map.atlas_layers.empty()) return false;
+    const AtlasImage& first = map.atlas_layers[0];
+    for (const AtlasImage& layer : map.atlas_layers) {
+        if (layer.format != TEX_RGBA8 || layer.width != first.width || layer.height != first.height ||
+            (int)layer.levels.size() < map.atlas_levels) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int levelFor(float texels_per_pixel, int levels) {
+    if (texels_per_pixel <= 1.0f) return 0;
+    return std::min((int)std::log2(texels_per_pixel), levels-1);
+}
+
+// One scanline's worth of world positions: start + step*c for pixel c
+struct RowSpan {
+    glm::vec2 start;
+    glm::vec2 step;
+    float scale_u, scale_v;     // world units to texels of the chosen level
+    int level_w, level_h;
+};
+
+bool isPow2(int v) {
+    return v > 0 && (v & (v-1)) == 0;
+}
+
+int wrap(int v, int size) {
+    v %= size;
+    return v < 0 ? v + size : v;
+}
+
+void rowAddressesScalar(const Map& map, const RowSpan& span, int from, int to, int32_t* cells, int32_t* texels) {
+    for (int c=from; c<to; c++) {
+        float wx = span.start.x + span.step.x*c;
+        float wy = span.start.y + span.step.y*c;
+        int cx = (int)std::floor(wx);
+        int cy = (int)std::floor(wy);
+        cells[c] = (cx >= 0 && cx < map.width && cy >= 0 && cy < map.height) ? cy*map.width + cx : -1;
+        int tu = wrap((int)std::floor(wx*span.scale_u), span.level_w);
+        int tv = wrap((int)std::floor(wy*span.scale_v), span.level_h);
+        texels[c] = tv*span.level_w + tu;
+    }
+}
+
+#if defined(__SSE2__)
+// floor() for SSE2, which only has truncation
+inline __m128i floor4(__m128 v) {
+    __m128i t = _mm_cvttps_epi32(v);
+    __m128 back = _mm_cvtepi32_ps(t);
+    return _mm_add_epi32(t, _mm_castps_si128(_mm_and_ps(_mm_cmplt_ps(v, back), _mm_castsi128_ps(_mm_set1_epi32(-1)))));
+}
+
+// Four pixels at a time. Power of two levels wrap with a mask and the row index is a
+// shift, the cell index goes through floats (exact for any map under 2^24 cells).
+void rowAddressesSSE2(const Map& map, const RowSpan& span, int count, int32_t* cells, int32_t* texels) {
+    int shift = 0;
+    while ((1 << shift) < span.level_w) shift++;
+    const __m128 lane = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+    const __m128 step_x = _mm_set1_ps(span.step.x);
+    const __m128 step_y = _mm_set1_ps(span.step.y);
+    const __m128 start_x = _mm_set1_ps(span.start.x);
+    const __m128 start_y = _mm_set1_ps(span.start.y);
+    const __m128 scale_u = _mm_set1_ps(span.scale_u);
+    const __m128 scale_v = _mm_set1_ps(span.scale_v);
+    const __m128i mask_u = _mm_set1_epi32(span.level_w-1);
+    const __m128i mask_v = _mm_set1_epi32(span.level_h-1);
+    const __m128i map_w = _mm_set1_epi32(map.width);
+    const __m128i map_h = _mm_set1_epi32(map.height);
+    const __m128 map_w_f = _mm_set1_ps((float)map.width);
+    const __m128i minus_one = _mm_set1_epi32(-1);
+    int c = 0;
+    for (; c+4<=count; c+=4) {
+        __m128 index = _mm_add_ps(_mm_set1_ps((float)c), lane);
+        __m128 wx = _mm_add_ps(start_x, _mm_mul_ps(step_x, index));
+        __m128 wy = _mm_add_ps(start_y, _mm_mul_ps(step_y, index));
+        __m128i cx = floor4(wx);
+        __m128i cy = floor4(wy);
+        __m128i inside = _mm_and_si128(
+            _mm_and_si128(_mm_cmpgt_epi32(cx, minus_one), _mm_cmplt_epi32(cx, map_w)),
+            _mm_and_si128(_mm_cmpgt_epi32(cy, minus_one), _mm_cmplt_epi32(cy, map_h)));
+        __m128i cell = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(cy), map_w_f), _mm_cvtepi32_ps(cx)));
+        cell = _mm_or_si128(_mm_and_si128(inside, cell), _mm_andnot_si128(inside, minus_one));
+        __m128i tu = _mm_and_si128(floor4(_mm_mul_ps(wx, scale_u)), mask_u);
+        __m128i tv = _mm_and_si128(floor4(_mm_mul_ps(wy, scale_v)), mask_v);
+        __m128i texel = _mm_or_si128(_mm_slli_epi32(tv, shift), tu);
+        _mm_storeu_si128((__m128i*)(cells + c), cell);
+        _mm_storeu_si128((__m128i*)(texels + c), texel);
+    }
+    rowAddressesScalar(map, span, c, count, cells, texels);
+}
+#endif
+
+void rowAddresses(const Map& map, const RowSpan& span, int count, int32_t* cells, int32_t* texels) {
+#if defined(__SSE2__)
+    if (isPow2(span.level_w) && isPow2(span.level_h)) {
+        rowAddressesSSE2(map, span, count, cells, texels);
+        return;
+    }
+#endif
+    rowAddressesScalar(map, span, 0, count, cells, texels);
+}
+
+}
+
+bool castFloorsCPU(const Map& map, const SoftwareView& view, SoftwareFrame& frame, FloorTiming& timing) {
+    if (!usableLayers(map) || map.floor_cells.size() != (size_t)map.width*map.height) return false;
+    const AtlasImage& first = map.atlas_layers[0];
+    float wall_height = map.manifest.wall_height;
+    int width = frame.width;
+    int height = frame.height;
+    std::vector<int32_t> cells(width);
+    std::vector<int32_t> texels(width);
+    // the column pass only ever uses the projected height symmetrically, so its sign
+    // (which the player's fov can flip) doesn't matter for which plane a row sees
+    float proj_scale = std::fabs(view.proj_scale);
+    const MapManifest& manifest = map.manifest;
+    float fog_density = manifest.fogDensity();
+    int fog_colour[3];
+    for (int k=0; k<3; k++) fog_colour[k] = manifest.fog_colour[k]*255.0f;
+
+    Clock::time_point clock = Clock::now();
+    for (int row=0; row<height/2; row++) {
+        // the eye is half way up the walls, so the ceiling row and its mirrored floor row
+        // both see the plane wall_height/2 away at the same distance along the view
+        float y = 1.0f - (row + 0.5f)*2.0f/height;
+        float dist = wall_height*proj_scale / y;
+        float next_dist = wall_height*proj_scale / std::max(y - 2.0f/height, 1e-6f);
+        // rows only get farther towards the horizon, everything from here on is past
+        // the view distance and left to the fog colour
+        if (dist > manifest.maxDist()) break;
+        RowSpan span;
+        span.start = view.pos + (view.dir + view.plane*(1.0f/width - 1.0f))*dist;
+        span.step = view.plane*(2.0f*dist/width);
+        // one mip level for the whole row, from the larger of the along-row and
+        // row-to-row footprints
+        float footprint = std::max(glm::length(span.step), next_dist - dist) / wall_height * first.width;
+        int level = levelFor(footprint * std::exp2(manifest.lodBias(dist)), map.atlas_levels);
+        span.level_w = first.levelWidth(level);
+        span.level_h = first.levelHeight(level);
+        span.scale_u = span.level_w / wall_height;
+        span.scale_v = span.level_h / wall_height;
+        timing.setup_ms += msSince(clock);
+
+        rowAddresses(map, span, width, cells.data(), texels.data());
+        timing.address_ms += msSince(clock);
+        // one fog value for the row, from its distance along the view
+        int visible = (int)(std::exp(-fog_density*std::max(dist - manifest.fog_start, 0.0f))*256.0f);
+        int fog[3];
+        for (int k=0; k<3; k++) fog[k] = fog_colour[k]*(256 - visible);
+
+        unsigned char* ceiling_row = &frame.pixels[(size_t)row*width*4];
+        unsigned char* floor_row = &frame.pixels[(size_t)(height-1-row)*width*4];
+        for (int c=0; c<width; c++) {
+            if (cells[c] < 0) continue;
+            uint32_t packed = map.floor_cells[cells[c]];
+            uint32_t floor_tex = packed & 0xffff;
+            uint32_t ceiling_tex = packed >> 16;
+            if (floor_tex < map.atlas_layers.size()) {
+                std::memcpy(floor_row + c*4, map.atlas_layers[floor_tex].levels[level].data() + texels[c]*4, 4);
+                timing.pixels++;
+            }
+            if (ceiling_tex < map.atlas_layers.size()) {
+                std::memcpy(ceiling_row + c*4, map.atlas_layers[ceiling_tex].levels[level].data() + texels[c]*4, 4);
+                timing.pixels++;
+            }
+        }
+        if (visible < 256) {
+            for (int c=0; c<width*4; c+=4) {
+                for (int k=0; k<3; k++) {
+                    floor_row[c+k] = (floor_row[c+k]*visible + fog[k]) >> 8;
+                    ceiling_row[c+k] = (ceiling_row[c+k]*visible + fog[k]) >> 8;
+                }
+            }
+        }
+        timing.shade_ms += msSince(clock);
+    }
+    return true;
+}
+
+int castWallsCPU(const Map& map, const SoftwareView& view, SoftwareFrame& frame, const LightGrid* lights) {
+    if (!usableLayers(map)) return 0;
+    const AtlasImage& first = map.atlas_layers[0];
+    const MapManifest& manifest = map.manifest;
+    float wall_height = manifest.wall_height;
+    float fog_density = manifest.fogDensity();
+    int width = frame.width;
+    int height = frame.height;
+    SpanBudget budget;
+    budget.see_through = 0;
+    budget.max_dist = manifest.maxDist();
+    ReflectionBudget reflections;
+    std::vector<WallSpan> spans;
+    std::vector<WallSpan> see_through;
+    // the whole frame's spans, and per column its first one and how many (-1 for
+    // columns that weren't covered)
+    std::vector<std::pair<int, int>> columns(width);
+    int drawn = 0;
+
+    auto drawSpan = [&](const WallSpan& span, int c, float view_cos) {
+        const RayHit& hit = span.hit;
+        if (hit.tex >= (int)map.atlas_layers.size() || span.v_top <= span.v_bottom) return;
+        float extent = wall_height/(hit.dist*view_cos)*std::fabs(view.proj_scale);
+        float y_bottom = span.bottom*extent;
+        float y_top = span.top*extent;
+        // texels of the whole texture against the pixels it would cover, with the far
+        // ones dropping to smaller mips like the column pass
+        float texture_pixels = (y_top - y_bottom)*height*0.5f / (span.v_top - span.v_bottom);
+        int level = levelFor(first.height / texture_pixels * std::exp2(manifest.lodBias(hit.dist)), map.atlas_levels);
+        int lw = first.levelWidth(level);
+        int lh = first.levelHeight(level);
+        const unsigned char* texels = map.atlas_layers[hit.tex].levels[level].data();
+        int tu = wrap((int)(hit.tex_x/wall_height * lw), lw);
+        // lightmap and dynamic light as 8.8 fixed point, same for the whole span like
+        // the GPU path, and so is the fog. Emissive faces aren't lit at all.
+        bool lit = (!map.lightmap.empty() || lights) && !(hit.flags & MAT_EMISSIVE);
+        glm::vec3 light(1.0f);
+        if (lit) {
+            light = map.lightmap.sample(hit.cell, hit.side, hit.face_u, glm::vec3(manifest.ambient));
+            if (lights) light += lights->faceLight(map, hit);
+        }
+        int light_fixed[3] = {(int)(light.r*256.0f), (int)(light.g*256.0f), (int)(light.b*256.0f)};
+        int visible = (int)(std::exp(-fog_density*std::max(hit.dist - manifest.fog_start, 0.0f))*256.0f);
+        int fog[3];
+        for (int k=0; k<3; k++) fog[k] = (int)(manifest.fog_colour[k]*255.0f)*(256 - visible);
+        int top = std::max(0, (int)std::ceil((1.0f - y_top)*height*0.5f - 0.5f));
+        int bottom = std::min(height-1, (int)std::floor((1.0f - y_bottom)*height*0.5f - 0.5f));
+        for (int row=top; row<=bottom; row++) {
+            // v runs 0-1 from the bottom of the wall to the top, like texPos in the
+            // column pass, texture rows run top down
+            float y = 1.0f - (row + 0.5f)*2.0f/height;
+            float v = span.v_bottom + (y - y_bottom)/(y_top - y_bottom)*(span.v_top - span.v_bottom);
+            int tv = std::clamp((int)((1.0f - v)*lh), 0, lh-1);
+            unsigned char* pixel = &frame.pixels[((size_t)row*width + c)*4];
+            std::memcpy(pixel, texels + (tv*lw + tu)*4, 4);
+            if (lit) {
+                for (int k=0; k<3; k++) pixel[k] = std::min(255, (pixel[k]*light_fixed[k]) >> 8);
+            }
+            if (visible < 256) {
+                for (int k=0; k<3; k++) pixel[k] = (pixel[k]*visible + fog[k]) >> 8;
+            }
+        }
+    };
+
+    // even columns first, then the odd ones, which can take the average of the columns
+    // either side of them when those are both far off on the same face
+    for (int pass=0; pass<2; pass++) {
+        for (int c=pass; c<width; c+=2) {
+            float camera_x = 2.0f * c / float(width) - 1.0f;
+            glm::vec2 ray_dir = glm::normalize(view.dir + view.plane * camera_x);
+            float view_cos = glm::dot(ray_dir, view.dir);
+            int first_span = spans.size();
+            WallSpan between;
+            const std::pair<int, int>* left = pass == 1 ? &columns[c-1] : nullptr;
+            const std::pair<int, int>* right = pass == 1 && c+1 < width ? &columns[c+1] : nullptr;
+            bool covered = true;
+            if (left && right && left->second == 1 && right->second == 1 &&
+                interpolateSpan(map, spans[left->first], spans[right->first], manifest.lod_distance, between)) {
+                spans.push_back(between);
+            }
+            else {
+                float covered_depth;
+                covered = castSpans(map, view.pos, ray_dir, view_cos, view.proj_scale, budget, spans, see_through, covered_depth);
+                reflectSpans(map, spans, first_span, budget.max_dist, reflections);
+            }
+            int count = spans.size() - first_span;
+            // only covered columns can stand in for the one between them
+            columns[c] = {first_span, covered ? count : -1};
+            drawn += count;
+            // spans come clipped against the nearer ones, so they can go straight in
+            for (int i=first_span; i<(int)spans.size(); i++) drawSpan(spans[i], c, view_cos);
+        }
+    }
+    return drawn;
+}
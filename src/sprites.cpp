@@ -0,0 +1,129 @@
+#include "../include/sprites.h"
+#include <glad/glad.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+// sprites closer than this along the view are behind the near plane
+const float near_depth = 0.05f;
+
+// one corner per vertex: x across the sprite from -0.5 to 0.5, y up from the floor 0 to 1
+const float quad[] = {
+    -0.5f, 0.0f,
+     0.5f, 0.0f,
+    -0.5f, 1.0f,
+     0.5f, 1.0f,
+};
+
+}
+
+void radixSortHigh32(std::vector<uint64_t>& items, std::vector<uint64_t>& scratch) {
+    scratch.resize(items.size());
+    for (int shift=32; shift<64; shift+=8) {
+        size_t offsets[256] = {};
+        for (uint64_t item : items) offsets[(item >> shift) & 0xff]++;
+        // a digit every item shares would just copy everything, skip the pass
+        if (items.empty() || offsets[(items[0] >> shift) & 0xff] == items.size()) continue;
+        size_t sum = 0;
+        for (size_t& offset : offsets) {
+            size_t count = offset;
+            offset = sum;
+            sum += count;
+        }
+        for (uint64_t item : items) scratch[offsets[(item >> shift) & 0xff]++] = item;
+        items.swap(scratch);
+    }
+}
+
+void SpriteRenderer::create() {
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &quad_vbo);
+    glGenBuffers(1, &instance_vbo);
+    glGenBuffers(1, &depth_buffer);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, quad_vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2*sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(SpriteInstance), (void*)0);
+    glVertexAttribDivisor(1, 1);
+    glEnableVertexAttribArray(1);
+}
+
+void SpriteRenderer::release() {
+    glDeleteVertexArrays(1, &vao);
+    glDeleteBuffers(1, &quad_vbo);
+    glDeleteBuffers(1, &instance_vbo);
+    glDeleteBuffers(1, &depth_buffer);
+    vao = quad_vbo = instance_vbo = depth_buffer = 0;
+    instance_capacity = depth_capacity = 0;
+}
+
+void SpriteRenderer::cull(const std::vector<Sprite>& sprites, glm::vec2 pos, glm::vec2 dir, glm::vec2 plane,
+                          const ColumnHiZ* hiz) {
+    auto start = std::chrono::steady_clock::now();
+    float plane_length2 = glm::dot(plane, plane);
+    float plane_length = std::sqrt(plane_length2);
+    keys.clear();
+    stats.occluded = 0;
+    for (size_t i=0; i<sprites.size(); i++) {
+        glm::vec2 to_sprite = sprites[i].pos - pos;
+        float depth = glm::dot(to_sprite, dir);
+        if (depth < near_depth) continue;
+        // screen x of the centre (same camera_x as the ray loop) and half the width
+        float camera_x = glm::dot(to_sprite, plane) / plane_length2 / depth;
+        float half_width = sprites[i].size*0.5f / (plane_length*depth);
+        if (camera_x + half_width < -1.0f || camera_x - half_width > 1.0f) continue;
+        if (hiz) {
+            int first, last;
+            hiz->columnRange(camera_x - half_width, camera_x + half_width, first, last);
+            if (hiz->occluded(first, last, depth)) {
+                stats.occluded++;
+                continue;
+            }
+        }
+        // positive floats sort like their bits, flipped so the farthest comes first
+        uint32_t bits;
+        std::memcpy(&bits, &depth, sizeof(bits));
+        keys.push_back((uint64_t)~bits << 32 | i);
+    }
+    auto culled = std::chrono::steady_clock::now();
+    radixSortHigh32(keys, scratch);
+
+    visible.resize(keys.size());
+    for (size_t i=0; i<keys.size(); i++) {
+        const Sprite& sprite = sprites[keys[i] & 0xffffffff];
+        visible[i] = {sprite.pos, sprite.size, (float)sprite.tex};
+    }
+    auto sorted = std::chrono::steady_clock::now();
+    stats.total = sprites.size();
+    stats.visible = visible.size();
+    stats.cull_ms = std::chrono::duration<double, std::milli>(culled - start).count();
+    stats.sort_ms = std::chrono::duration<double, std::milli>(sorted - culled).count();
+}
+
+void SpriteRenderer::setColumnDepth(const std::vector<float>& depth) {
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, depth_buffer);
+    if (depth.size() > depth_capacity) {
+        depth_capacity = depth.size();
+        glBufferData(GL_SHADER_STORAGE_BUFFER, depth_capacity*sizeof(float), NULL, GL_DYNAMIC_DRAW);
+    }
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, depth.size()*sizeof(float), depth.data());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, depth_buffer);
+}
+
+void SpriteRenderer::draw() {
+    if (visible.empty()) return;
+    glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+    if (visible.size() > instance_capacity) {
+        instance_capacity = visible.size() * 2;
+        glBufferData(GL_ARRAY_BUFFER, instance_capacity*sizeof(SpriteInstance), NULL, GL_STREAM_DRAW);
+    }
+    glBufferSubData(GL_ARRAY_BUFFER, 0, visible.size()*sizeof(SpriteInstance), visible.data());
+    glBindVertexArray(vao);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, visible.size());
+}
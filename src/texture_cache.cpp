@@ -0,0 +1,254 @@
+#include "../include/texture_cache.h"
+#include "../include/assets.h"
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+// glad was generated without the S3TC extension
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+#endif
+
+namespace {
+
+const char cache_magic[8] = {'R', 'T', 'E', 'X', ' ', '0', '1', '\n'};
+const uint32_t cache_version = 1;
+
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t tiles_x;
+    uint32_t tiles_y;
+    uint32_t level_count;
+    uint32_t reserved;
+    uint64_t source_hash;
+};
+
+struct LevelIndex {
+    uint64_t offset;
+    uint64_t size;
+};
+
+// box filter one tile of src (stw x sth) into dst (dtw x dth), clamping at the tile edge
+void downsampleTile(const unsigned char* src, int src_w, int sx, int sy, int stw, int sth,
+                    unsigned char* dst, int dst_w, int dx, int dy, int dtw, int dth) {
+    for (int y=0; y<dth; y++) {
+        int y0 = std::min(2*y, sth-1);
+        int y1 = std::min(2*y+1, sth-1);
+        for (int x=0; x<dtw; x++) {
+            int x0 = std::min(2*x, stw-1);
+            int x1 = std::min(2*x+1, stw-1);
+            const unsigned char* p00 = src + ((sy+y0)*src_w + sx+x0)*4;
+            const unsigned char* p01 = src + ((sy+y0)*src_w + sx+x1)*4;
+            const unsigned char* p10 = src + ((sy+y1)*src_w + sx+x0)*4;
+            const unsigned char* p11 = src + ((sy+y1)*src_w + sx+x1)*4;
+            unsigned char* out = dst + ((dy+y)*dst_w + dx+x)*4;
+            for (int c=0; c<4; c++) {
+                out[c] = (unsigned char)((p00[c] + p01[c] + p10[c] + p11[c] + 2) / 4);
+            }
+        }
+    }
+}
+
+}
+
+std::string textureCachePath(uint64_t hash, const std::string& suffix) {
+    std::stringstream ss;
+    ss << "cache/textures/" << std::hex << hash << std::dec << "-" << suffix << ".rtex";
+    return ss.str();
+}
+
+void buildTileMips(AtlasImage& img) {
+    if (img.levels.empty()) return;
+    int level = img.levels.size()-1;
+    // GL wants max(1, width >> level) at every level, past the first one where the tiles
+    // round down to something else the whole image is no longer a valid mip level
+    while ((img.tileWidth(level) > 1 || img.tileHeight(level) > 1) &&
+           img.levelWidth(level+1) == std::max(1, img.width >> (level+1)) &&
+           img.levelHeight(level+1) == std::max(1, img.height >> (level+1))) {
+        int stw = img.tileWidth(level);
+        int sth = img.tileHeight(level);
+        int dtw = img.tileWidth(level+1);
+        int dth = img.tileHeight(level+1);
+        int src_w = img.levelWidth(level);
+        int dst_w = img.levelWidth(level+1);
+        std::vector<unsigned char> dst(dst_w * img.levelHeight(level+1) * 4);
+        const unsigned char* src = img.levels[level].data();
+        for (int ty=0; ty<img.tiles_y; ty++) {
+            for (int tx=0; tx<img.tiles_x; tx++) {
+                downsampleTile(src, src_w, tx*stw, ty*sth, stw, sth,
+                               dst.data(), dst_w, tx*dtw, ty*dth, dtw, dth);
+            }
+        }
+        img.levels.push_back(std::move(dst));
+        level++;
+    }
+}
+
+bool readTextureCache(const std::string& path, uint64_t source_hash, AtlasImage& img) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+    CacheHeader header;
+    if (!file.read((char*)&header, sizeof(header))) return false;
+    if (std::memcmp(header.magic, cache_magic, sizeof(cache_magic)) != 0 ||
+        header.version != cache_version || header.format > TEX_BC7 ||
+        header.source_hash != source_hash || header.tiles_x == 0 || header.tiles_y == 0 ||
+        header.level_count == 0 || header.level_count > 32) {
+        return false;
+    }
+    std::vector<LevelIndex> index(header.level_count);
+    if (!file.read((char*)index.data(), index.size()*sizeof(LevelIndex))) return false;
+
+    img.width = header.width;
+    img.height = header.height;
+    img.tiles_x = header.tiles_x;
+    img.tiles_y = header.tiles_y;
+    img.format = header.format;
+    img.levels.resize(header.level_count);
+    for (uint32_t i=0; i<header.level_count; i++) {
+        uint64_t expected = img.levelSize(i);
+        if (index[i].size != expected) return false;
+        img.levels[i].resize(expected);
+        file.seekg(index[i].offset);
+        if (!file.read((char*)img.levels[i].data(), expected)) return false;
+    }
+    return true;
+}
+
+bool writeTextureCache(const std::string& path, uint64_t source_hash, const AtlasImage& img) {
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+    // write to a temporary first so a crash never leaves a truncated cache entry behind
+    std::string tmp_path = path + ".tmp";
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!file) return false;
+
+    CacheHeader header = {};
+    std::memcpy(header.magic, cache_magic, sizeof(cache_magic));
+    header.version = cache_version;
+    header.format = img.format;
+    header.width = img.width;
+    header.height = img.height;
+    header.tiles_x = img.tiles_x;
+    header.tiles_y = img.tiles_y;
+    header.level_count = img.levels.size();
+    header.source_hash = source_hash;
+
+    std::vector<LevelIndex> index(img.levels.size());
+    uint64_t offset = sizeof(header) + index.size()*sizeof(LevelIndex);
+    for (size_t i=0; i<img.levels.size(); i++) {
+        index[i].offset = offset;
+        index[i].size = img.levels[i].size();
+        offset += img.levels[i].size();
+    }
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)index.data(), index.size()*sizeof(LevelIndex));
+    for (const std::vector<unsigned char>& level : img.levels) {
+        file.write((const char*)level.data(), level.size());
+    }
+    file.close();
+    if (!file) return false;
+    std::filesystem::rename(tmp_path, path, ec);
+    return !ec;
+}
+
+bool loadAtlasImage(const std::string& png_path, int tiles_x, int tiles_y, AtlasImage& img) {
+    Asset png;
+    if (!loadAsset(png_path, png)) return false;
+    uint64_t hash = hashBytes(png.data, png.size);
+    std::string cache_path = textureCachePath(hash, std::to_string(tiles_x) + "x" + std::to_string(tiles_y));
+    if (readTextureCache(cache_path, hash, img) && img.format == TEX_RGBA8) return true;
+
+    int width, height, channels;
+    unsigned char* data = stbi_load_from_memory(png.data, png.size, &width, &height, &channels, 4);
+    if (!data) return false;
+    img.width = width;
+    img.height = height;
+    // tiles that don't divide the atlas evenly fall back to plain whole-image mips
+    bool even_tiles = tiles_x > 0 && tiles_y > 0 && width % tiles_x == 0 && height % tiles_y == 0;
+    img.tiles_x = even_tiles ? tiles_x : 1;
+    img.tiles_y = even_tiles ? tiles_y : 1;
+    img.levels.assign(1, std::vector<unsigned char>(data, data + width*height*4));
+    stbi_image_free(data);
+    buildTileMips(img);
+
+    if (!writeTextureCache(cache_path, hash, img)) {
+        std::cout << "Could not write texture cache " << cache_path << "\n";
+    }
+    return true;
+}
+
+void splitTiles(const AtlasImage& atlas, std::vector<AtlasImage>& tiles) {
+    tiles.resize(atlas.tiles_x * atlas.tiles_y);
+    for (int t=0; t<atlas.tiles_x*atlas.tiles_y; t++) {
+        AtlasImage& tile = tiles[t];
+        tile.width = atlas.tileWidth(0);
+        tile.height = atlas.tileHeight(0);
+        tile.tiles_x = 1;
+        tile.tiles_y = 1;
+        tile.levels.resize(atlas.levels.size());
+        for (size_t level=0; level<atlas.levels.size(); level++) {
+            int tw = atlas.tileWidth(level);
+            int th = atlas.tileHeight(level);
+            int atlas_w = atlas.levelWidth(level);
+            int x0 = (t%atlas.tiles_x) * tw;
+            int y0 = (t/atlas.tiles_x) * th;
+            std::vector<unsigned char>& dst = tile.levels[level];
+            dst.resize(tw*th*4);
+            for (int y=0; y<th; y++) {
+                const unsigned char* row = atlas.levels[level].data() + ((y0+y)*atlas_w + x0)*4;
+                std::copy(row, row + tw*4, dst.data() + y*tw*4);
+            }
+        }
+        // the atlas chain stops early when tiles aren't a power of two, a tile on its
+        // own can go all the way down
+        buildTileMips(tile);
+    }
+}
+
+void extractRect(const AtlasImage& page, int x, int y, int w, int h, AtlasImage& out) {
+    out.width = w;
+    out.height = h;
+    out.tiles_x = 1;
+    out.tiles_y = 1;
+    out.levels.assign(1, std::vector<unsigned char>(w*h*4));
+    for (int row=0; row<h; row++) {
+        const unsigned char* src = page.levels[0].data() + ((y+row)*page.width + x)*4;
+        std::copy(src, src + w*4, out.levels[0].data() + row*w*4);
+    }
+    buildTileMips(out);
+}
+
+unsigned int createAtlasArray(const AtlasImage& img, int layers, int levels) {
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    GLenum internal_format = GL_RGBA8;
+    if (img.format == TEX_BC1) internal_format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+    else if (img.format == TEX_BC7) internal_format = GL_COMPRESSED_RGBA_BPTC_UNORM;
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, internal_format, img.width, img.height, layers);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels-1);
+    return texture;
+}
+
+void uploadAtlasLevel(const AtlasImage& img, int layer, int level) {
+    if (img.format != TEX_RGBA8) {
+        GLenum internal_format = img.format == TEX_BC1 ? GL_COMPRESSED_RGBA_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_BPTC_UNORM;
+        glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, img.levelWidth(level), img.levelHeight(level), 1,
+                                  internal_format, img.levels[level].size(), img.levels[level].data());
+        return;
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, img.levelWidth(level), img.levelHeight(level), 1,
+                    GL_RGBA, GL_UNSIGNED_BYTE, img.levels[level].data());
+}
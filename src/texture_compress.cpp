@@ -0,0 +1,308 @@
+#include "../include/texture_compress.h"
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+std::atomic<bool> bc1_supported(false);
+std::atomic<bool> bc7_supported(false);
+
+// Part of every cache key, bump it whenever encodeBC1Block or encodeBC7Block change
+// what they write so cache/textures stops handing out blocks from the old encoder
+const uint32_t encoder_version = 1;
+
+// 4x4 block starting at (bx, by), clamped to the image
+void fetchBlock(const unsigned char* rgba, int w, int h, int bx, int by, float block[16][4]) {
+    for (int y=0; y<4; y++) {
+        int sy = std::min(by+y, h-1);
+        for (int x=0; x<4; x++) {
+            int sx = std::min(bx+x, w-1);
+            const unsigned char* p = rgba + (sy*w + sx)*4;
+            for (int c=0; c<4; c++) block[y*4+x][c] = p[c];
+        }
+    }
+}
+
+// Principal axis of the block's colours through their mean, in `channels` dimensions,
+// then the two points on it that bound every pixel (mask picks the pixels to use)
+void fitLine(const float block[16][4], int channels, const bool mask[16], float e0[4], float e1[4]) {
+    float mean[4] = {0, 0, 0, 0};
+    int count = 0;
+    for (int i=0; i<16; i++) {
+        if (!mask[i]) continue;
+        for (int c=0; c<channels; c++) mean[c] += block[i][c];
+        count++;
+    }
+    if (count == 0) count = 1;
+    for (int c=0; c<channels; c++) mean[c] /= count;
+
+    float cov[4][4] = {};
+    for (int i=0; i<16; i++) {
+        if (!mask[i]) continue;
+        for (int a=0; a<channels; a++) {
+            for (int b=0; b<channels; b++) {
+                cov[a][b] += (block[i][a]-mean[a]) * (block[i][b]-mean[b]);
+            }
+        }
+    }
+    float axis[4] = {1, 1, 1, 1};
+    for (int iter=0; iter<8; iter++) {
+        float next[4] = {0, 0, 0, 0};
+        for (int a=0; a<channels; a++) {
+            for (int b=0; b<channels; b++) next[a] += cov[a][b] * axis[b];
+        }
+        float len = 0.0f;
+        for (int c=0; c<channels; c++) len += next[c]*next[c];
+        if (len < 1e-12f) break;
+        len = std::sqrt(len);
+        for (int c=0; c<channels; c++) axis[c] = next[c] / len;
+    }
+
+    float t_min = 1e30f, t_max = -1e30f;
+    for (int i=0; i<16; i++) {
+        if (!mask[i]) continue;
+        float t = 0.0f;
+        for (int c=0; c<channels; c++) t += (block[i][c]-mean[c]) * axis[c];
+        t_min = std::min(t_min, t);
+        t_max = std::max(t_max, t);
+    }
+    if (t_min > t_max) t_min = t_max = 0.0f;
+    for (int c=0; c<channels; c++) {
+        e0[c] = std::clamp(mean[c] + axis[c]*t_min, 0.0f, 255.0f);
+        e1[c] = std::clamp(mean[c] + axis[c]*t_max, 0.0f, 255.0f);
+    }
+}
+
+float distance(const float a[4], const float b[4], int channels) {
+    float d = 0.0f;
+    for (int c=0; c<channels; c++) d += (a[c]-b[c]) * (a[c]-b[c]);
+    return d;
+}
+
+uint16_t pack565(const float c[4]) {
+    int r = std::clamp((int)std::lround(c[0] * 31.0f / 255.0f), 0, 31);
+    int g = std::clamp((int)std::lround(c[1] * 63.0f / 255.0f), 0, 63);
+    int b = std::clamp((int)std::lround(c[2] * 31.0f / 255.0f), 0, 31);
+    return (r << 11) | (g << 5) | b;
+}
+
+void unpack565(uint16_t v, float c[4]) {
+    int r = v >> 11, g = (v >> 5) & 63, b = v & 31;
+    c[0] = (r << 3) | (r >> 2);
+    c[1] = (g << 2) | (g >> 4);
+    c[2] = (b << 3) | (b >> 2);
+    c[3] = 255.0f;
+}
+
+void encodeBC1Block(const float block[16][4], unsigned char* out) {
+    bool opaque[16];
+    bool has_alpha = false;
+    for (int i=0; i<16; i++) {
+        opaque[i] = block[i][3] >= 128.0f;
+        if (!opaque[i]) has_alpha = true;
+    }
+    float e0[4], e1[4];
+    fitLine(block, 3, opaque, e0, e1);
+    uint16_t c0 = pack565(e1);
+    uint16_t c1 = pack565(e0);
+    // c0 > c1 selects the 4 colour mode, c0 <= c1 the 3 colour + transparent one
+    if (has_alpha ? c0 > c1 : c0 < c1) std::swap(c0, c1);
+
+    float palette[4][4];
+    unpack565(c0, palette[0]);
+    unpack565(c1, palette[1]);
+    int colours = 4;
+    if (c0 > c1) {
+        for (int c=0; c<3; c++) {
+            palette[2][c] = (2*palette[0][c] + palette[1][c]) / 3.0f;
+            palette[3][c] = (palette[0][c] + 2*palette[1][c]) / 3.0f;
+        }
+    }
+    else {
+        for (int c=0; c<3; c++) palette[2][c] = (palette[0][c] + palette[1][c]) / 2.0f;
+        colours = 3;
+    }
+
+    uint32_t indices = 0;
+    for (int i=0; i<16; i++) {
+        int best = 0;
+        if (!opaque[i]) best = 3;
+        else if (c0 != c1) {
+            float best_d = 1e30f;
+            for (int p=0; p<colours; p++) {
+                float d = distance(block[i], palette[p], 3);
+                if (d < best_d) {
+                    best_d = d;
+                    best = p;
+                }
+            }
+        }
+        indices |= best << (2*i);
+    }
+    out[0] = c0 & 0xff;
+    out[1] = c0 >> 8;
+    out[2] = c1 & 0xff;
+    out[3] = c1 >> 8;
+    for (int i=0; i<4; i++) out[4+i] = (indices >> (8*i)) & 0xff;
+}
+
+// BC7 is encoded in mode 6 only: one subset, 7.7.7.7 endpoints with a p-bit each and
+// 4 bit indices. It handles alpha and smooth gradients well, which covers wall textures.
+const int bc7_weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+void quantizeBC7(const float e[4], int q[4], int& pbit) {
+    float best_err = 1e30f;
+    for (int p=0; p<2; p++) {
+        int cand[4];
+        float err = 0.0f;
+        for (int c=0; c<4; c++) {
+            cand[c] = std::clamp((int)std::lround((e[c] - p) / 2.0f), 0, 127);
+            float v = cand[c]*2 + p;
+            err += (v - e[c]) * (v - e[c]);
+        }
+        if (err < best_err) {
+            best_err = err;
+            pbit = p;
+            std::copy(cand, cand+4, q);
+        }
+    }
+}
+
+struct BitWriter {
+    unsigned char* out;
+    int pos = 0;
+    void write(uint32_t value, int bits) {
+        for (int i=0; i<bits; i++, pos++) {
+            if (value & (1u << i)) out[pos/8] |= 1 << (pos%8);
+        }
+    }
+};
+
+void encodeBC7Block(const float block[16][4], unsigned char* out) {
+    bool all[16];
+    std::fill(all, all+16, true);
+    float e0[4], e1[4];
+    fitLine(block, 4, all, e0, e1);
+    int q0[4], q1[4], p0, p1;
+    quantizeBC7(e0, q0, p0);
+    quantizeBC7(e1, q1, p1);
+
+    float palette[16][4];
+    for (int i=0; i<16; i++) {
+        for (int c=0; c<4; c++) {
+            int a = q0[c]*2 + p0;
+            int b = q1[c]*2 + p1;
+            palette[i][c] = ((64-bc7_weights[i])*a + bc7_weights[i]*b + 32) >> 6;
+        }
+    }
+    int indices[16];
+    for (int i=0; i<16; i++) {
+        float best_d = 1e30f;
+        for (int p=0; p<16; p++) {
+            float d = distance(block[i], palette[p], 4);
+            if (d < best_d) {
+                best_d = d;
+                indices[i] = p;
+            }
+        }
+    }
+    // the first index is stored with its top bit implied 0, swap endpoints to make it so
+    if (indices[0] >= 8) {
+        std::swap(q0, q1);
+        std::swap(p0, p1);
+        for (int i=0; i<16; i++) indices[i] = 15 - indices[i];
+    }
+
+    std::memset(out, 0, 16);
+    BitWriter bits{out};
+    bits.write(1 << 6, 7);
+    for (int c=0; c<4; c++) {
+        bits.write(q0[c], 7);
+        bits.write(q1[c], 7);
+    }
+    bits.write(p0, 1);
+    bits.write(p1, 1);
+    bits.write(indices[0], 3);
+    for (int i=1; i<16; i++) bits.write(indices[i], 4);
+}
+
+template <typename Encoder>
+void encodeBlocks(const unsigned char* rgba, int w, int h, unsigned char* out, int block_bytes, Encoder encode) {
+    float block[16][4];
+    for (int by=0; by<h; by+=4) {
+        for (int bx=0; bx<w; bx+=4) {
+            fetchBlock(rgba, w, h, bx, by, block);
+            encode(block, out);
+            out += block_bytes;
+        }
+    }
+}
+
+}
+
+void encodeBC1(const unsigned char* rgba, int w, int h, unsigned char* out) {
+    encodeBlocks(rgba, w, h, out, 8, encodeBC1Block);
+}
+
+void encodeBC7(const unsigned char* rgba, int w, int h, unsigned char* out) {
+    encodeBlocks(rgba, w, h, out, 16, encodeBC7Block);
+}
+
+void detectCompressionSupport() {
+    bool s3tc = false;
+    int count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (int i=0; i<count; i++) {
+        const char* name = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if (name && std::strcmp(name, "GL_EXT_texture_compression_s3tc") == 0) s3tc = true;
+    }
+    bc1_supported = s3tc;
+    bc7_supported = GLAD_GL_VERSION_4_2 != 0;
+}
+
+TextureFormat chooseFormat(const AtlasImage& img, const std::string& mode) {
+    if (mode == "none" || img.levels.empty()) return TEX_RGBA8;
+    if (mode == "bc1") return bc1_supported ? TEX_BC1 : TEX_RGBA8;
+    if (mode == "bc7") return bc7_supported ? TEX_BC7 : TEX_RGBA8;
+
+    bool opaque = true;
+    const std::vector<unsigned char>& base = img.levels[0];
+    for (size_t i=3; i<base.size() && opaque; i+=4) {
+        if (base[i] != 255) opaque = false;
+    }
+    if (opaque && bc1_supported) return TEX_BC1;
+    return bc7_supported ? TEX_BC7 : TEX_RGBA8;
+}
+
+void compressImage(AtlasImage& img, TextureFormat format) {
+    if (format == TEX_RGBA8 || img.format != TEX_RGBA8) return;
+    uint64_t hash = hashBytes(img.levels[0].data(), img.levels[0].size());
+    hash = hashBytes(&img.width, sizeof(img.width), hash);
+    hash = hashBytes(&img.height, sizeof(img.height), hash);
+    hash = hashBytes(&encoder_version, sizeof(encoder_version), hash);
+    std::string suffix = format == TEX_BC1 ? "bc1" : "bc7";
+    std::string path = textureCachePath(hash, suffix);
+
+    AtlasImage cached;
+    if (readTextureCache(path, hash, cached) && cached.format == (uint32_t)format &&
+        cached.width == img.width && cached.height == img.height && cached.levels.size() == img.levels.size()) {
+        img = std::move(cached);
+        return;
+    }
+
+    AtlasImage compressed = img;
+    compressed.format = format;
+    for (size_t level=0; level<img.levels.size(); level++) {
+        int w = img.levelWidth(level);
+        int h = img.levelHeight(level);
+        compressed.levels[level].assign(levelBytes(format, w, h), 0);
+        if (format == TEX_BC1) encodeBC1(img.levels[level].data(), w, h, compressed.levels[level].data());
+        else encodeBC7(img.levels[level].data(), w, h, compressed.levels[level].data());
+    }
+    writeTextureCache(path, hash, compressed);
+    img = std::move(compressed);
+}
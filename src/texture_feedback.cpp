@@ -0,0 +1,79 @@
+#include "../include/texture_feedback.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// far enough apart to be cheap, close enough that no page is skipped: at the level the
+// shader picks a pixel is at most two texels, so a step covers well under a page
+const int floor_step_x = 16;
+const int floor_step_y = 8;
+
+}
+
+void requestFloorPages(const Map& map, VirtualTexture& vt, const SoftwareView& view, int width, int height,
+                       const std::vector<float>& column_depth) {
+    const MapManifest& manifest = map.manifest;
+    float wall_height = manifest.wall_height;
+    float proj = std::abs(view.proj_scale);
+    float max_dist = manifest.maxDist();
+    int half = height/2;
+    for (int x=0; x<width; x+=floor_step_x) {
+        float ndc_x = 2.0f*x/width - 1.0f;
+        glm::vec2 ray = view.dir + view.plane*ndc_x;
+        float ray_length = glm::length(ray);
+        float wall_depth = x < (int)column_depth.size() ? column_depth[x] : max_dist;
+        // out from the horizon, the same distance for a floor row and its ceiling row
+        for (int y=floor_step_y/2; y<half; y+=floor_step_y) {
+            float ndc_y = (y + 0.5f) / half;
+            float dist = wall_height * proj / ndc_y;
+            if (dist >= wall_depth || dist*ray_length > max_dist) continue;
+            glm::vec2 world = view.pos + ray*dist;
+            glm::ivec2 cell = glm::ivec2(glm::floor(world));
+            if (cell.x < 0 || cell.y < 0 || cell.x >= map.width || cell.y >= map.height) continue;
+            // uv per pixel across (along the plane) and down (along the ray, as the
+            // distance changes with the row), like the shader's dFdx and dFdy
+            glm::vec2 uv = world / wall_height;
+            glm::vec2 dx = view.plane * (dist / wall_height * 2.0f / width);
+            glm::vec2 dy = ray * (dist / ndc_y / wall_height / half);
+            float bias = manifest.lodBias(dist*ray_length);
+            uint32_t textures = map.floor_cells[cell.y*map.width + cell.x];
+            for (uint32_t tex : {textures & 0xffffu, textures >> 16}) {
+                if (tex != 0xffffu) vt.requestArea(tex, uv, uv, dx, dy, bias);
+            }
+        }
+    }
+}
+
+void requestSpritePages(const Map& map, VirtualTexture& vt, const SoftwareView& view, int width, int height,
+                        const std::vector<SpriteInstance>& sprites) {
+    float proj = std::abs(view.proj_scale);
+    float plane_length = glm::length(view.plane);
+    for (const SpriteInstance& sprite : sprites) {
+        glm::vec2 to_sprite = sprite.pos - view.pos;
+        float depth = glm::dot(to_sprite, view.dir);
+        if (depth <= 0.0f) continue;
+        // the quad's size in pixels, projected like vSpriteShader does, gives the uv per pixel
+        float pixels_wide = sprite.size / (plane_length*depth) * width * 0.5f;
+        float pixels_tall = sprite.size * proj / depth * height;
+        glm::vec2 dx(1.0f / std::max(pixels_wide, 1e-4f), 0.0f);
+        glm::vec2 dy(0.0f, 1.0f / std::max(pixels_tall, 1e-4f));
+        float camera_x = glm::dot(to_sprite, view.plane) / glm::dot(view.plane, view.plane) / depth;
+        float bias = map.manifest.lodBias(depth * glm::length(view.dir + view.plane*camera_x));
+        vt.requestArea((int)sprite.tex, glm::vec2(0.0f), glm::vec2(1.0f), dx, dy, bias);
+    }
+}
+
+void requestSkyPages(const Map& map, VirtualTexture& vt, float view_angle, float fov, int width, int height) {
+    const MapManifest& manifest = map.manifest;
+    if (manifest.sky_texture < 0) return;
+    // u goes round with the angle of the column's ray, fastest per pixel in the middle
+    // of the screen where atan is steepest; v from 1 at the top to 0 at the horizon
+    float turns = manifest.sky_repeats / 6.2831853f;
+    glm::vec2 uv_min((view_angle - fov*0.5f) * turns, 0.0f);
+    glm::vec2 uv_max((view_angle + fov*0.5f) * turns, 1.0f);
+    glm::vec2 dx(std::abs(std::tan(fov*0.5f)) * 2.0f / width * turns, 0.0f);
+    glm::vec2 dy(0.0f, 2.0f / height);
+    vt.requestArea(manifest.sky_texture, uv_min, uv_max, dx, dy, 0.0f);
+}
@@ -0,0 +1,72 @@
+// Bakes files into a C++ source so the game starts without touching the disk.
+//
+//   asset_embed <output.cpp> <root folder> <file>...
+//
+// Files are named by their path relative to root, which is also how the game asks for
+// them (see assets.h). The output holds one array per file and a sorted index.
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct Entry {
+    std::string path;
+    std::vector<unsigned char> data;
+};
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cout << "Usage: asset_embed <output.cpp> <root folder> <file>...\n";
+        return 1;
+    }
+    std::filesystem::path out_path = argv[1];
+    std::filesystem::path root = argv[2];
+
+    std::vector<Entry> entries;
+    for (int i=3; i<argc; i++) {
+        std::filesystem::path path = argv[i];
+        if (path.is_relative()) path = root / path;
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            std::cout << "Could not read " << path << "\n";
+            return 1;
+        }
+        Entry entry;
+        entry.path = std::filesystem::relative(path, root).generic_string();
+        entry.data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        entries.push_back(std::move(entry));
+    }
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.path < b.path; });
+
+    std::stringstream out;
+    out << "// Generated by asset_embed, do not edit\n#include \"assets.h\"\n\nnamespace {\n\n";
+    size_t total = 0;
+    for (size_t i=0; i<entries.size(); i++) {
+        out << "// " << entries[i].path << "\nalignas(16) const unsigned char asset_" << i << "[] = {";
+        for (size_t b=0; b<entries[i].data.size(); b++) {
+            if (b % 24 == 0) out << "\n    ";
+            out << (int)entries[i].data[b] << ",";
+        }
+        out << "\n    0\n};\n\n";
+        total += entries[i].data.size();
+    }
+    out << "}\n\nextern const EmbeddedAsset embedded_assets[] = {\n";
+    for (size_t i=0; i<entries.size(); i++) {
+        out << "    {\"" << entries[i].path << "\", asset_" << i << ", " << entries[i].data.size() << "},\n";
+    }
+    if (entries.empty()) out << "    {\"\", nullptr, 0},\n";
+    out << "};\nextern const size_t embedded_asset_count = " << entries.size() << ";\n";
+
+    if (out_path.has_parent_path()) std::filesystem::create_directories(out_path.parent_path());
+    std::ofstream file(out_path, std::ios::binary | std::ios::trunc);
+    file << out.str();
+    if (!file) {
+        std::cout << "Could not write " << out_path << "\n";
+        return 1;
+    }
+    std::cout << "Embedded " << entries.size() << " assets, " << total/1024 << " KiB\n";
+    return 0;
+}
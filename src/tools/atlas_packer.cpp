@@ -0,0 +1,359 @@
+// Packs a folder of wall textures into one or more atlas pages.
+//
+//   atlas_packer <texture folder> <map folder> [page size] [padding]
+//
+// Textures are numbered in file name order, that number is the texture index used by
+// the materials in map.json. The map folder gets walls_atlas_<n>.png for every page and
+// an atlas.json with the page list and one rect per texture, which loadMap picks up.
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+#include <json.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+struct Texture {
+    std::string name;
+    int width, height;
+    std::vector<unsigned char> pixels;
+    int page, x, y;
+};
+
+struct Shelf {
+    int y, height, cursor;
+};
+
+struct Page {
+    std::vector<Shelf> shelves;
+    int used_height = 0;
+};
+
+uint32_t crc_table[256];
+
+void initCrc() {
+    for (uint32_t n=0; n<256; n++) {
+        uint32_t c = n;
+        for (int k=0; k<8; k++) c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        crc_table[n] = c;
+    }
+}
+
+uint32_t crc(const unsigned char* data, size_t len, uint32_t c = 0xffffffffu) {
+    for (size_t i=0; i<len; i++) c = crc_table[(c ^ data[i]) & 0xff] ^ (c >> 8);
+    return c;
+}
+
+void putBE(std::vector<unsigned char>& out, uint32_t v) {
+    out.push_back(v >> 24);
+    out.push_back(v >> 16);
+    out.push_back(v >> 8);
+    out.push_back(v);
+}
+
+void writeChunk(std::ofstream& file, const char* type, const std::vector<unsigned char>& data) {
+    std::vector<unsigned char> chunk;
+    putBE(chunk, data.size());
+    chunk.insert(chunk.end(), type, type+4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    putBE(chunk, crc(chunk.data()+4, chunk.size()-4) ^ 0xffffffffu);
+    file.write((const char*)chunk.data(), chunk.size());
+}
+
+// Deflate bits go out least significant first, Huffman codes most significant first
+struct BitWriter {
+    std::vector<unsigned char>& out;
+    uint32_t bits = 0;
+    int count = 0;
+
+    void put(uint32_t value, int n) {
+        bits |= value << count;
+        count += n;
+        while (count >= 8) {
+            out.push_back(bits & 0xff);
+            bits >>= 8;
+            count -= 8;
+        }
+    }
+    void putCode(uint32_t code, int n) {
+        uint32_t reversed = 0;
+        for (int i=0; i<n; i++) reversed |= ((code >> i) & 1) << (n-1-i);
+        put(reversed, n);
+    }
+    void flush() {
+        if (count > 0) out.push_back(bits & 0xff);
+        bits = 0;
+        count = 0;
+    }
+};
+
+// the fixed Huffman code of a literal/length symbol
+void putSymbol(BitWriter& writer, int symbol) {
+    if (symbol < 144) writer.putCode(0x30 + symbol, 8);
+    else if (symbol < 256) writer.putCode(0x190 + symbol-144, 9);
+    else if (symbol < 280) writer.putCode(symbol-256, 7);
+    else writer.putCode(0xc0 + symbol-280, 8);
+}
+
+const int length_base[] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
+                           67, 83, 99, 115, 131, 163, 195, 227, 258};
+const int length_extra[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                            4, 4, 4, 4, 5, 5, 5, 5, 0};
+const int dist_base[] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+                         1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+const int dist_extra[] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8,
+                          9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+// zlib stream of one fixed Huffman block. Matches come from hash chains over the last
+// 32 KiB, greedy and at most max_chain candidates deep, which is plenty for atlas pages:
+// the padding, empty space and repeated rows are where the bytes go.
+std::vector<unsigned char> deflate(const std::vector<unsigned char>& data) {
+    const int window = 32768;
+    const int max_match = 258;
+    const int max_chain = 64;
+    std::vector<unsigned char> out = {0x78, 0x5e};
+    BitWriter writer{out};
+    writer.put(1, 1);           // last block
+    writer.put(1, 2);           // fixed Huffman codes
+
+    int n = data.size();
+    std::vector<int> head(1 << 15, -1);
+    std::vector<int> prev(window, -1);
+    auto insert = [&](int i) {
+        if (i+2 >= n) return;
+        int h = ((data[i] << 10) ^ (data[i+1] << 5) ^ data[i+2]) & 0x7fff;
+        prev[i & (window-1)] = head[h];
+        head[h] = i;
+    };
+    int i = 0;
+    while (i < n) {
+        int best_len = 0, best_dist = 0;
+        if (i+2 < n) {
+            int h = ((data[i] << 10) ^ (data[i+1] << 5) ^ data[i+2]) & 0x7fff;
+            int limit = std::min(max_match, n-i);
+            int candidate = head[h];
+            for (int chain=0; candidate >= 0 && i-candidate <= window && chain < max_chain; chain++) {
+                int len = 0;
+                while (len < limit && data[candidate+len] == data[i+len]) len++;
+                if (len > best_len) {
+                    best_len = len;
+                    best_dist = i-candidate;
+                    if (len == limit) break;
+                }
+                candidate = prev[candidate & (window-1)];
+            }
+        }
+        if (best_len < 3) {
+            putSymbol(writer, data[i]);
+            insert(i++);
+            continue;
+        }
+        int code = 28;
+        while (length_base[code] > best_len) code--;
+        putSymbol(writer, 257 + code);
+        writer.put(best_len - length_base[code], length_extra[code]);
+        code = 29;
+        while (dist_base[code] > best_dist) code--;
+        writer.putCode(code, 5);
+        writer.put(best_dist - dist_base[code], dist_extra[code]);
+        for (int end=i+best_len; i<end; i++) insert(i);
+    }
+    putSymbol(writer, 256);
+    writer.flush();
+
+    uint32_t a = 1, b = 0;
+    for (unsigned char c : data) {
+        a = (a + c) % 65521;
+        b = (b + a) % 65521;
+    }
+    putBE(out, (b << 16) | a);
+    return out;
+}
+
+int paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = std::abs(p-a), pb = std::abs(p-b), pc = std::abs(p-c);
+    if (pa <= pb && pa <= pc) return a;
+    return pb <= pc ? b : c;
+}
+
+// RGBA8 png, every row with whichever of the five filters leaves the smallest sum of
+// (signed) bytes, the usual guess at what deflates best
+bool writePng(const std::string& path, int width, int height, const std::vector<unsigned char>& rgba) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file) return false;
+    const unsigned char signature[] = {137, 80, 78, 71, 13, 10, 26, 10};
+    file.write((const char*)signature, sizeof(signature));
+
+    std::vector<unsigned char> ihdr;
+    putBE(ihdr, width);
+    putBE(ihdr, height);
+    ihdr.insert(ihdr.end(), {8, 6, 0, 0, 0});
+    writeChunk(file, "IHDR", ihdr);
+
+    int stride = width*4;
+    std::vector<unsigned char> raw;
+    raw.reserve(height * (stride + 1));
+    std::vector<unsigned char> filtered(stride), best(stride);
+    for (int y=0; y<height; y++) {
+        const unsigned char* row = &rgba[y*stride];
+        const unsigned char* up = y > 0 ? row - stride : nullptr;
+        long best_cost = -1;
+        int best_filter = 0;
+        for (int filter=0; filter<5; filter++) {
+            long cost = 0;
+            for (int x=0; x<stride; x++) {
+                int a = x >= 4 ? row[x-4] : 0;
+                int b = up ? up[x] : 0;
+                int c = up && x >= 4 ? up[x-4] : 0;
+                int predicted = 0;
+                if (filter == 1) predicted = a;
+                else if (filter == 2) predicted = b;
+                else if (filter == 3) predicted = (a + b) / 2;
+                else if (filter == 4) predicted = paeth(a, b, c);
+                filtered[x] = row[x] - predicted;
+                cost += std::abs((int)(signed char)filtered[x]);
+            }
+            if (best_cost < 0 || cost < best_cost) {
+                best_cost = cost;
+                best_filter = filter;
+                best.swap(filtered);
+            }
+        }
+        raw.push_back(best_filter);
+        raw.insert(raw.end(), best.begin(), best.end());
+    }
+    writeChunk(file, "IDAT", deflate(raw));
+    writeChunk(file, "IEND", {});
+    return (bool)file;
+}
+
+// shelf packing, tallest textures first. Returns false if tex can't fit on any page.
+bool place(std::vector<Page>& pages, Texture& tex, int page_size, int padding) {
+    int w = tex.width + 2*padding;
+    int h = tex.height + 2*padding;
+    if (w > page_size || h > page_size) return false;
+    for (size_t p=0; p<pages.size(); p++) {
+        for (Shelf& shelf : pages[p].shelves) {
+            if (h <= shelf.height && shelf.cursor + w <= page_size) {
+                tex.page = p;
+                tex.x = shelf.cursor + padding;
+                tex.y = shelf.y + padding;
+                shelf.cursor += w;
+                return true;
+            }
+        }
+        if (pages[p].used_height + h <= page_size) {
+            pages[p].shelves.push_back({pages[p].used_height, h, w});
+            tex.page = p;
+            tex.x = padding;
+            tex.y = pages[p].used_height + padding;
+            pages[p].used_height += h;
+            return true;
+        }
+    }
+    pages.emplace_back();
+    return place(pages, tex, page_size, padding);
+}
+
+// copies tex into its page, repeating the edge texels out into the padding so the
+// mip levels above log2(padding) never pick up a neighbour
+void blit(const Texture& tex, std::vector<unsigned char>& page, int page_size, int padding) {
+    for (int y=-padding; y<tex.height+padding; y++) {
+        int sy = std::clamp(y, 0, tex.height-1);
+        for (int x=-padding; x<tex.width+padding; x++) {
+            int sx = std::clamp(x, 0, tex.width-1);
+            const unsigned char* src = &tex.pixels[(sy*tex.width + sx)*4];
+            unsigned char* dst = &page[((tex.y+y)*page_size + tex.x+x)*4];
+            std::copy(src, src+4, dst);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cout << "Usage: atlas_packer <texture folder> <map folder> [page size] [padding]\n";
+        return 1;
+    }
+    std::filesystem::path in_dir = argv[1];
+    std::filesystem::path out_dir = argv[2];
+    int page_size = argc > 3 ? std::stoi(argv[3]) : 2048;
+    int padding = argc > 4 ? std::stoi(argv[4]) : 8;
+    initCrc();
+
+    std::vector<std::filesystem::path> files;
+    for (const auto& entry : std::filesystem::directory_iterator(in_dir)) {
+        if (entry.path().extension() == ".png") files.push_back(entry.path());
+    }
+    std::sort(files.begin(), files.end());
+    if (files.empty()) {
+        std::cout << "No png files in " << in_dir << "\n";
+        return 1;
+    }
+
+    std::vector<Texture> textures;
+    for (const std::filesystem::path& path : files) {
+        int w, h, n;
+        unsigned char* data = stbi_load(path.string().c_str(), &w, &h, &n, 4);
+        if (!data) {
+            std::cout << "Could not load " << path << "\n";
+            return 1;
+        }
+        textures.push_back({path.stem().string(), w, h, std::vector<unsigned char>(data, data + w*h*4), 0, 0, 0});
+        stbi_image_free(data);
+    }
+
+    std::vector<int> order(textures.size());
+    for (size_t i=0; i<order.size(); i++) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+        return textures[a].height > textures[b].height;
+    });
+    std::vector<Page> pages(1);
+    for (int i : order) {
+        if (!place(pages, textures[i], page_size, padding)) {
+            std::cout << textures[i].name << " (" << textures[i].width << "x" << textures[i].height
+                      << ") does not fit on a " << page_size << " page\n";
+            return 1;
+        }
+    }
+
+    std::filesystem::create_directories(out_dir);
+    std::vector<std::string> page_names;
+    for (size_t p=0; p<pages.size(); p++) {
+        std::vector<unsigned char> pixels(page_size*page_size*4, 0);
+        for (const Texture& tex : textures) {
+            if (tex.page == (int)p) blit(tex, pixels, page_size, padding);
+        }
+        page_names.push_back("walls_atlas_" + std::to_string(p) + ".png");
+        if (!writePng((out_dir / page_names.back()).string(), page_size, page_size, pixels)) {
+            std::cout << "Could not write " << out_dir / page_names.back() << "\n";
+            return 1;
+        }
+    }
+
+    // names can hold anything a file name can, so the json library does the escaping
+    nlohmann::ordered_json atlas;
+    atlas["padding"] = padding;
+    atlas["pages"] = page_names;
+    atlas["rects"] = nlohmann::ordered_json::array();
+    for (const Texture& tex : textures) {
+        atlas["rects"].push_back({{"name", tex.name}, {"page", tex.page}, {"x", tex.x}, {"y", tex.y},
+                                  {"w", tex.width}, {"h", tex.height}});
+    }
+    nlohmann::ordered_json root;
+    root["atlas"] = atlas;
+    std::ofstream json(out_dir / "atlas.json");
+    json << root.dump(4) << "\n";
+    if (!json) {
+        std::cout << "Could not write " << out_dir / "atlas.json" << "\n";
+        return 1;
+    }
+
+    std::cout << "Packed " << textures.size() << " textures into " << pages.size() << " page(s) of "
+              << page_size << "x" << page_size << "\n";
+    return 0;
+}
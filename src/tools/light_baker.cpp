@@ -0,0 +1,156 @@
+// Bakes the lights listed in a map's map.json into its lightmap.
+//
+//   light_baker <map name> [samples per face] [threads]
+//
+// Every wall face with an open cell in front of it gets samples light values across it:
+// the map's ambient plus, for each light that castRay can reach from the sample point,
+// a Lambert term with a quadratic falloff to nothing at the light's radius. Area lights
+// average a 4x4 grid of points over their square, which softens the shadow edges.
+// The faces are shared out between the threads and every thread sums all the lights
+// for its own faces, so no two threads ever write the same slot. The result goes to
+// maps/<map>/<"lightmap" in map.json>, where loadMap picks it up.
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include "../../include/map.h"
+#include "../../include/raycast.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct Face {
+    int cell;
+    int side;
+    glm::vec2 start;        // the low x (or y) end
+    glm::vec2 along;        // start to the other end
+    glm::vec2 normal;       // out of the wall
+};
+
+std::vector<Face> visibleFaces(const Map& map) {
+    std::vector<Face> faces;
+    for (int y=0; y<map.height; y++) {
+        for (int x=0; x<map.width; x++) {
+            int value = map.grid[y*map.width + x];
+            // a moving block's cells change as it goes, and emissive faces are drawn at full
+            // brightness, there is nothing to bake for either
+            if (value == 0 || value == moving_cell || (map.materials.flags[value] & MAT_EMISSIVE)) continue;
+            for (int side=0; side<4; side++) {
+                int nx = x + face_normal_x[side];
+                int ny = y + face_normal_y[side];
+                if (nx < 0 || nx >= map.width || ny < 0 || ny >= map.height || map.grid[ny*map.width + nx] != 0) continue;
+                Face face;
+                face.cell = y*map.width + x;
+                face.side = side;
+                face.normal = glm::vec2(face_normal_x[side], face_normal_y[side]);
+                // the face sits on the cell edge its normal points out of
+                face.start = glm::vec2(x + (side == 2 ? 1 : 0), y + (side == 1 ? 1 : 0));
+                face.along = side == 0 || side == 2 ? glm::vec2(0.0f, 1.0f) : glm::vec2(1.0f, 0.0f);
+                faces.push_back(face);
+            }
+        }
+    }
+    return faces;
+}
+
+// Points a light shines from, one for a point light and a grid over an area light
+std::vector<glm::vec2> lightPoints(const Light& light) {
+    if (light.size <= 0.0f) return {light.pos};
+    const int grid = 4;
+    std::vector<glm::vec2> points;
+    for (int j=0; j<grid; j++) {
+        for (int i=0; i<grid; i++) {
+            glm::vec2 offset((i + 0.5f)/grid - 0.5f, (j + 0.5f)/grid - 0.5f);
+            points.push_back(light.pos + offset*light.size);
+        }
+    }
+    return points;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cout << "Usage: light_baker <map name> [samples per face] [threads]\n";
+        return 1;
+    }
+    std::string name = argv[1];
+    int samples = argc > 2 ? std::max(1, std::stoi(argv[2])) : 16;
+    int thread_count = argc > 3 ? std::stoi(argv[3]) : std::thread::hardware_concurrency();
+    thread_count = std::max(1, thread_count);
+
+    Map map;
+    if (!loadMap(name, map)) {
+        std::cout << "Map " << name << " did not load.\n";
+        return 1;
+    }
+    if (map.manifest.lights.empty()) std::cout << "No lights in maps/" << name << "/map.json, baking ambient only.\n";
+    std::vector<std::vector<glm::vec2>> light_points;
+    for (const Light& light : map.manifest.lights) light_points.push_back(lightPoints(light));
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<Face> faces = visibleFaces(map);
+    Lightmap lightmap;
+    lightmap.samples = samples;
+    lightmap.face_slot.assign((size_t)map.width*map.height*4, -1);
+    lightmap.rgb.resize(faces.size()*samples*3);
+    for (size_t slot=0; slot<faces.size(); slot++) lightmap.face_slot[faces[slot].cell*4 + faces[slot].side] = slot;
+
+    std::atomic<size_t> next_face(0);
+    std::atomic<long> rays(0);
+    auto worker = [&]() {
+        const size_t chunk = 16;
+        long cast = 0;
+        while (true) {
+            size_t first = next_face.fetch_add(chunk);
+            if (first >= faces.size()) break;
+            size_t last = std::min(first + chunk, faces.size());
+            for (size_t slot=first; slot<last; slot++) {
+                const Face& face = faces[slot];
+                for (int s=0; s<samples; s++) {
+                    // just off the wall, in the open cell in front of it
+                    glm::vec2 point = face.start + face.along*((s + 0.5f)/samples) + face.normal*1e-3f;
+                    glm::vec3 total(map.manifest.ambient);
+                    for (size_t l=0; l<light_points.size(); l++) {
+                        const Light& light = map.manifest.lights[l];
+                        float sum = 0.0f;
+                        for (glm::vec2 from : light_points[l]) {
+                            glm::vec2 to_light = from - point;
+                            float dist = glm::length(to_light);
+                            if (dist >= light.radius || dist < 1e-4f) continue;
+                            glm::vec2 dir = to_light / dist;
+                            float lambert = glm::dot(face.normal, dir);
+                            if (lambert <= 0.0f) continue;
+                            RayHit hit;
+                            cast++;
+                            if (castRay(map, point, dir, hit) && hit.dist < dist) continue;
+                            float falloff = 1.0f - dist/light.radius;
+                            sum += lambert * falloff*falloff;
+                        }
+                        total += light.colour * light.intensity * (sum / light_points[l].size());
+                    }
+                    uint8_t* out = &lightmap.rgb[(slot*samples + s)*3];
+                    for (int k=0; k<3; k++) out[k] = (uint8_t)std::clamp(total[k]*0.5f*255.0f + 0.5f, 0.0f, 255.0f);
+                }
+            }
+        }
+        rays += cast;
+    };
+    std::vector<std::thread> threads;
+    for (int i=0; i<thread_count; i++) threads.emplace_back(worker);
+    for (std::thread& thread : threads) thread.join();
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::string path = "maps/" + name + "/" + map.manifest.lightmap;
+    if (!saveLightmap(path, map.width, map.height, lightmap)) {
+        std::cout << "Could not write " << path << "\n";
+        return 1;
+    }
+    std::cout << "Baked " << map.manifest.lights.size() << " lights onto " << faces.size() << " faces (" << samples
+              << " samples each) with " << thread_count << " threads in " << ms << " ms, " << rays.load()
+              << " shadow rays, into " << path << "\n";
+    return 0;
+}
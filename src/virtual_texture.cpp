@@ -0,0 +1,379 @@
+#include "../include/virtual_texture.h"
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+const char page_magic[8] = {'R', 'T', 'V', 'P', ' ', '0', '1', '\n'};
+const uint32_t page_version = 1;
+const size_t page_bytes = (size_t)VirtualTexture::physical_size * VirtualTexture::physical_size * 4;
+
+// Page file: header, then every page of every level of every texture in page table order
+struct PageFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t physical_size;
+    uint32_t page_count;
+    uint32_t reserved;
+    uint64_t source_hash;
+};
+
+// One page of level `level` of img, borders included. Texels wrap like GL_REPEAT, which
+// also fills levels smaller than a page with copies of themselves.
+void cutPage(const AtlasImage& img, int level, int page_x, int page_y, unsigned char* out) {
+    int w = img.levelWidth(level);
+    int h = img.levelHeight(level);
+    const unsigned char* src = img.levels[level].data();
+    for (int y=0; y<VirtualTexture::physical_size; y++) {
+        int sy = page_y*VirtualTexture::page_size + y - VirtualTexture::page_border;
+        sy = ((sy % h) + h) % h;
+        for (int x=0; x<VirtualTexture::physical_size; x++) {
+            int sx = page_x*VirtualTexture::page_size + x - VirtualTexture::page_border;
+            sx = ((sx % w) + w) % w;
+            std::memcpy(out, src + (sy*w + sx)*4, 4);
+            out += 4;
+        }
+    }
+}
+
+bool readPage(std::ifstream& file, int page, unsigned char* out) {
+    file.clear();
+    file.seekg(sizeof(PageFileHeader) + (uint64_t)page*page_bytes);
+    return (bool)file.read((char*)out, page_bytes);
+}
+
+}
+
+VirtualTexture::~VirtualTexture() {
+    release();
+}
+
+int VirtualTexture::pageOf(int texture, int level, int page_x, int page_y) const {
+    const VirtualLevelInfo& info = levels[textures[texture].level_base + level];
+    return info.page_base + page_y*info.pages_x + page_x;
+}
+
+bool VirtualTexture::build(const std::vector<AtlasImage>& layers, int level_count) {
+    textures.clear();
+    levels.clear();
+    page_level.clear();
+    // one pinned tail per texture, and room for what is streamed in beside them
+    if (layers.size() + uploads_per_frame*2 > (size_t)min_array_layers) {
+        std::cout << "Virtual texture: " << layers.size() << " textures leave no room to stream pages in "
+                  << min_array_layers << " layers\n";
+        return false;
+    }
+    uint64_t hash = hashBytes(nullptr, 0);
+    int pages = 0;
+    for (const AtlasImage& img : layers) {
+        if (img.format != TEX_RGBA8 || img.tiles_x != 1 || img.tiles_y != 1) return false;
+        VirtualTextureInfo info = {(int32_t)levels.size(), 0, img.width, img.height};
+        for (int level=0; level<level_count && level<(int)img.levels.size(); level++) {
+            VirtualLevelInfo level_info = {};
+            level_info.page_base = pages;
+            level_info.pages_x = (img.levelWidth(level) + page_size-1) / page_size;
+            level_info.pages_y = (img.levelHeight(level) + page_size-1) / page_size;
+            levels.push_back(level_info);
+            pages += level_info.pages_x * level_info.pages_y;
+            page_level.insert(page_level.end(), level_info.pages_x * level_info.pages_y, level);
+            info.level_count++;
+            // the first level that fits in one page is the tail, everything below it
+            // would be a single page too and is left to the tail's bilinear filtering
+            if (level_info.pages_x == 1 && level_info.pages_y == 1) break;
+        }
+        textures.push_back(info);
+        hash = hashBytes(img.levels[0].data(), img.levels[0].size(), hash);
+        hash = hashBytes(&info, sizeof(info), hash);
+    }
+    page_table.assign(pages, -1);
+    page_frame.assign(pages, 0);
+    page_queued.assign(pages, 0);
+
+    std::stringstream ss;
+    ss << "cache/textures/" << std::hex << hash << std::dec << "-vt" << page_size << ".rtvp";
+    page_path = ss.str();
+
+    PageFileHeader header = {};
+    std::ifstream cached(page_path, std::ios::binary);
+    bool valid = cached && cached.read((char*)&header, sizeof(header)) &&
+                 std::memcmp(header.magic, page_magic, sizeof(page_magic)) == 0 &&
+                 header.version == page_version && header.physical_size == (uint32_t)physical_size &&
+                 header.page_count == (uint32_t)pages && header.source_hash == hash;
+    cached.close();
+    if (!valid) {
+        std::error_code ec;
+        std::filesystem::create_directories(std::filesystem::path(page_path).parent_path(), ec);
+        std::string tmp_path = page_path + ".tmp";
+        std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            std::cout << "Could not write page file " << page_path << "\n";
+            return false;
+        }
+        header = {};
+        std::memcpy(header.magic, page_magic, sizeof(page_magic));
+        header.version = page_version;
+        header.physical_size = physical_size;
+        header.page_count = pages;
+        header.source_hash = hash;
+        file.write((const char*)&header, sizeof(header));
+        std::vector<unsigned char> page(page_bytes);
+        for (size_t t=0; t<layers.size(); t++) {
+            for (int level=0; level<textures[t].level_count; level++) {
+                const VirtualLevelInfo& info = levels[textures[t].level_base + level];
+                for (int py=0; py<info.pages_y; py++) {
+                    for (int px=0; px<info.pages_x; px++) {
+                        cutPage(layers[t], level, px, py, page.data());
+                        file.write((const char*)page.data(), page.size());
+                    }
+                }
+            }
+        }
+        file.close();
+        if (!file) return false;
+        std::filesystem::rename(tmp_path, page_path, ec);
+        if (ec) return false;
+    }
+
+    std::ifstream file(page_path, std::ios::binary);
+    tail_pages.assign(textures.size(), std::vector<unsigned char>(page_bytes));
+    for (size_t t=0; t<textures.size(); t++) {
+        int tail = pageOf(t, textures[t].level_count-1, 0, 0);
+        if (!readPage(file, tail, tail_pages[t].data())) return false;
+    }
+    std::cout << "Virtual texture: " << textures.size() << " textures, " << pages << " pages of "
+              << page_size << "x" << page_size << " in " << page_path << "\n";
+    return true;
+}
+
+void VirtualTexture::create(size_t vram_budget) {
+    int max_layers = 0;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+    // the pinned tails plus enough room to stream something in
+    int min_slots = textures.size() + uploads_per_frame*2;
+    int slot_count = std::max<int>(vram_budget / page_bytes, min_slots);
+    if ((size_t)slot_count*page_bytes > vram_budget) {
+        std::cout << "Virtual texture budget raised to " << slot_count*page_bytes/(1 << 20) << " MiB for "
+                  << textures.size() << " pinned pages\n";
+    }
+    if (slot_count > max_layers) {
+        // build() left room for min_slots in the least any driver has, only streaming pages go
+        std::cout << "Virtual texture cache cut to " << max_layers << " pages, the most one array holds\n";
+        slot_count = max_layers;
+    }
+    slots.assign(slot_count, Slot());
+
+    glGenTextures(1, &cache_texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, cache_texture);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RGBA8, physical_size, physical_size, slot_count);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (size_t t=0; t<textures.size() && (int)t<slot_count; t++) {
+        int page = pageOf(t, textures[t].level_count-1, 0, 0);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, t, physical_size, physical_size, 1,
+                        GL_RGBA, GL_UNSIGNED_BYTE, tail_pages[t].data());
+        slots[t].page = page;
+        slots[t].pinned = true;
+        page_table[page] = t;
+        resident++;
+    }
+    tail_pages.clear();
+    tail_pages.shrink_to_fit();
+
+    glGenBuffers(1, &textures_buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, textures_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, textures.size()*sizeof(VirtualTextureInfo), textures.data(), GL_STATIC_DRAW);
+    glGenBuffers(1, &levels_buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, levels_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, levels.size()*sizeof(VirtualLevelInfo), levels.data(), GL_STATIC_DRAW);
+    glGenBuffers(1, &pages_buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, pages_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, page_table.size()*sizeof(int32_t), page_table.data(), GL_DYNAMIC_DRAW);
+
+    stopping = false;
+    streamer = std::thread(&VirtualTexture::stream, this);
+}
+
+void VirtualTexture::release() {
+    if (streamer.joinable()) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        streamer.join();
+    }
+    if (cache_texture != 0) glDeleteTextures(1, &cache_texture);
+    if (textures_buffer != 0) glDeleteBuffers(1, &textures_buffer);
+    if (levels_buffer != 0) glDeleteBuffers(1, &levels_buffer);
+    if (pages_buffer != 0) glDeleteBuffers(1, &pages_buffer);
+    cache_texture = textures_buffer = levels_buffer = pages_buffer = 0;
+}
+
+void VirtualTexture::request(int texture, float u, float v_min, float v_max, float line_height) {
+    if (texture < 0 || texture >= (int)textures.size() || line_height <= 0.0f) return;
+    const VirtualTextureInfo& info = textures[texture];
+    // same choice the shader makes from its derivatives: texels per pixel down the column
+    float lod = std::log2(std::max(info.height / line_height, 1.0f));
+    int level = std::min((int)lod, info.level_count-1);
+    const VirtualLevelInfo& level_info = levels[info.level_base + level];
+
+    int w = std::max(info.width >> level, 1);
+    int h = std::max(info.height >> level, 1);
+    u -= std::floor(u);
+    int page_x = std::min((int)(u*w) / page_size, level_info.pages_x-1);
+    int first_y = std::clamp((int)(v_min*h) / page_size, 0, level_info.pages_y-1);
+    int last_y = std::clamp((int)(v_max*h) / page_size, 0, level_info.pages_y-1);
+    for (int page_y=first_y; page_y<=last_y; page_y++) {
+        want(level_info.page_base + page_y*level_info.pages_x + page_x);
+    }
+}
+
+void VirtualTexture::requestArea(int texture, glm::vec2 uv_min, glm::vec2 uv_max, glm::vec2 dx, glm::vec2 dy, float bias) {
+    if (texture < 0 || texture >= (int)textures.size()) return;
+    const VirtualTextureInfo& info = textures[texture];
+    glm::vec2 size(info.width, info.height);
+    float lod = std::log2(std::max(std::max(glm::length(dx*size), glm::length(dy*size)), 1.0f)) + bias;
+    int level = std::clamp((int)lod, 0, info.level_count-1);
+    const VirtualLevelInfo& level_info = levels[info.level_base + level];
+
+    // the pages one axis covers, as up to two runs when the range wraps past 1
+    auto runs = [](float lo, float hi, int texels, int pages, int (&first)[2], int (&last)[2]) {
+        auto pageAt = [&](float t) { return std::min((int)(t*texels) / page_size, pages-1); };
+        if (hi - lo >= 1.0f) {
+            first[0] = 0;
+            last[0] = pages-1;
+            return 1;
+        }
+        float start = lo - std::floor(lo);
+        float end = start + (hi - lo);
+        first[0] = pageAt(start);
+        if (end < 1.0f) {
+            last[0] = pageAt(end);
+            return 1;
+        }
+        last[0] = pages-1;
+        first[1] = 0;
+        last[1] = pageAt(end - 1.0f);
+        return 2;
+    };
+    int first_x[2], last_x[2], first_y[2], last_y[2];
+    int runs_x = runs(uv_min.x, uv_max.x, std::max(info.width >> level, 1), level_info.pages_x, first_x, last_x);
+    int runs_y = runs(uv_min.y, uv_max.y, std::max(info.height >> level, 1), level_info.pages_y, first_y, last_y);
+    for (int ry=0; ry<runs_y; ry++) {
+        for (int page_y=first_y[ry]; page_y<=last_y[ry]; page_y++) {
+            for (int rx=0; rx<runs_x; rx++) {
+                for (int page_x=first_x[rx]; page_x<=last_x[rx]; page_x++) {
+                    want(level_info.page_base + page_y*level_info.pages_x + page_x);
+                }
+            }
+        }
+    }
+}
+
+void VirtualTexture::want(int page) {
+    if (page_frame[page] == frame) return;
+    page_frame[page] = frame;
+    if (page_table[page] >= 0) slots[page_table[page]].last_used = frame;
+    else if (!page_queued[page]) missing.push_back(page);
+}
+
+// least recently used page that wasn't needed this frame, or -1 if the cache is all in use
+int VirtualTexture::claimSlot() {
+    int best = -1;
+    for (size_t i=0; i<slots.size(); i++) {
+        if (slots[i].pinned) continue;
+        if (slots[i].page < 0) return i;
+        if (slots[i].last_used != frame && (best < 0 || slots[i].last_used < slots[best].last_used)) best = i;
+    }
+    if (best >= 0) {
+        page_table[slots[best].page] = -1;
+        slots[best].page = -1;
+        resident--;
+    }
+    return best;
+}
+
+void VirtualTexture::update() {
+    if (cache_texture == 0) return;
+    std::vector<LoadedPage> ready;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        // whatever wasn't loaded yet and isn't wanted any more is dropped
+        for (int page : load_queue) page_queued[page] = 0;
+        load_queue.clear();
+        std::stable_sort(missing.begin(), missing.end(), [&](int a, int b) {
+            return page_level[a] > page_level[b];
+        });
+        for (int page : missing) {
+            if (page_queued[page] || page_table[page] >= 0) continue;
+            page_queued[page] = 1;
+            load_queue.push_back(page);
+        }
+        size_t take = std::min(loaded.size(), uploads_per_frame);
+        ready.assign(std::make_move_iterator(loaded.begin()), std::make_move_iterator(loaded.begin()+take));
+        loaded.erase(loaded.begin(), loaded.begin()+take);
+        for (const LoadedPage& page : ready) page_queued[page.page] = 0;
+    }
+    missing.clear();
+    if (!load_queue.empty()) wake.notify_one();
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, cache_texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (const LoadedPage& page : ready) {
+        if (page.pixels.empty() || page_table[page.page] >= 0) continue;
+        int slot = claimSlot();
+        if (slot < 0) break;
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, slot, physical_size, physical_size, 1,
+                        GL_RGBA, GL_UNSIGNED_BYTE, page.pixels.data());
+        slots[slot].page = page.page;
+        slots[slot].last_used = frame;
+        page_table[page.page] = slot;
+        resident++;
+        table_dirty = true;
+    }
+    if (table_dirty) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, pages_buffer);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, page_table.size()*sizeof(int32_t), page_table.data());
+        table_dirty = false;
+    }
+    frame++;
+}
+
+void VirtualTexture::bind() const {
+    glBindTexture(GL_TEXTURE_2D_ARRAY, cache_texture);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, textures_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, levels_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, pages_buffer);
+}
+
+void VirtualTexture::stream() {
+    std::ifstream file(page_path, std::ios::binary);
+    while (true) {
+        int page;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wake.wait(guard, [this]() { return stopping || !load_queue.empty(); });
+            if (stopping) return;
+            page = load_queue.front();
+            load_queue.pop_front();
+        }
+        LoadedPage result{page, std::vector<unsigned char>(page_bytes)};
+        if (!readPage(file, page, result.pixels.data())) {
+            std::cout << "Could not read page " << page << " from " << page_path << "\n";
+            result.pixels.clear();
+        }
+        // failed pages go back empty, update() unqueues them so they get asked for again
+        std::lock_guard<std::mutex> guard(lock);
+        loaded.push_back(std::move(result));
+    }
+}
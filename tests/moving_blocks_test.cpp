@@ -0,0 +1,128 @@
+// Moving blocks: castRay against a block part way between two cells, a pushed block
+// settling back into the grid, and a long run of random steps with several blocks
+// ping-ponging while others stop, checking after every step that the grid, the
+// moving_cells table and moving_blocks still agree. Prints each failure and exits
+// non-zero if there were any.
+#include "test_map.h"
+
+#include "../include/moving_blocks.h"
+
+namespace {
+
+const int size = 9;
+const int pushed = 2*4;         // material 2, the one that moves
+
+// Every moving_cell in the grid is in moving_cells, every entry there points at a block
+// covering that cell, and every block's two cells point back at it
+bool consistent(const Map& map) {
+    for (int cell=0; cell<(int)map.grid.size(); cell++) {
+        auto it = map.moving_cells.find(cell);
+        if ((map.grid[cell] == moving_cell) != (it != map.moving_cells.end())) return false;
+    }
+    for (const auto& [cell, index] : map.moving_cells) {
+        if (index < 0 || index >= (int)map.moving_blocks.size()) return false;
+        const MovingBlock& block = map.moving_blocks[index];
+        int from = block.y*map.width + block.x;
+        int to = (block.y + block.dy)*map.width + block.x + block.dx;
+        if (cell != from && cell != to) return false;
+    }
+    for (int i=0; i<(int)map.moving_blocks.size(); i++) {
+        const MovingBlock& block = map.moving_blocks[i];
+        for (int step=0; step<2; step++) {
+            auto it = map.moving_cells.find((block.y + step*block.dy)*map.width + block.x + step*block.dx);
+            if (it == map.moving_cells.end() || it->second != i) return false;
+        }
+    }
+    return map.moving_cells.size() == 2*map.moving_blocks.size();
+}
+
+}
+
+int main() {
+    // one block pushed two cells east from (3, 4) at a cell a second
+    Map map = room(size, {SHAPE_BLOCK});
+    map.grid[4*size + 3] = pushed;
+    glm::vec2 west(1.5f, 4.5f);
+    expectHit(map, "standing still", west, glm::vec2(1.0f, 0.0f), 4*size + 3, 0, 1.5f);
+    std::vector<CellEdit> started;
+    expect(startMoving(map, 3, 4, 1, 0, 2, 1.0f, false, &started), "startMoving failed");
+    expect(started.size() == 2 && started[1].x == 4 && started[1].old_value == 0 && started[1].value == moving_cell,
+           "startMoving didn't report the cells it took");
+    expect(!startMoving(map, 3, 4, 1, 0, 2, 1.0f, false), "startMoving took a block that was already moving");
+    expectHit(map, "offset 0", west, glm::vec2(1.0f, 0.0f), 4*size + 3, 0, 1.5f);
+
+    updateMovingBlocks(map, 0.25f);
+    expectHit(map, "offset 0.25 along the ray", west, glm::vec2(1.0f, 0.0f), 4*size + 3, 0, 1.75f);
+    expectHit(map, "offset 0.25 from the far side", glm::vec2(6.5f, 4.5f), glm::vec2(-1.0f, 0.0f),
+              4*size + 4, 2, 2.25f);
+    expectHit(map, "offset 0.25 from the north, in the first cell", glm::vec2(3.5f, 1.5f), glm::vec2(0.0f, 1.0f),
+              4*size + 3, 3, 2.5f);
+    expectHit(map, "offset 0.25 from the north, in the second cell", glm::vec2(4.1f, 1.5f), glm::vec2(0.0f, 1.0f),
+              4*size + 4, 3, 2.5f);
+    // the strip the block has left behind is open, the ray carries on to the far wall
+    expectHit(map, "offset 0.25 from the north, behind it", glm::vec2(3.1f, 1.5f), glm::vec2(0.0f, 1.0f),
+              8*size + 3, 3, 6.5f);
+    expectHit(map, "offset 0.25 diagonally onto its top", glm::vec2(1.5f, 1.5f), glm::vec2(1.0f, 1.0f), any_cell, 3,
+              2.5f*std::sqrt(2.0f));
+    expect(consistent(map), "tables disagree at offset 0.25");
+
+    updateMovingBlocks(map, 1.0f);
+    expectHit(map, "offset 1.25", west, glm::vec2(1.0f, 0.0f), 4*size + 4, 0, 2.75f);
+    expect(consistent(map), "tables disagree at offset 1.25");
+
+    updateMovingBlocks(map, 1.0f);
+    expect(map.grid[4*size + 5] == pushed, "the block didn't settle two cells on");
+    expect(map.grid[4*size + 3] == 0 && map.grid[4*size + 4] == 0, "the block left cells behind");
+    expect(map.moving_blocks.empty() && map.moving_cells.empty(), "the settled block is still moving");
+    expectHit(map, "settled", west, glm::vec2(1.0f, 0.0f), 4*size + 5, 0, 3.5f);
+
+    // a short push that stops on the first update, so the last of the ping-pong blocks
+    // takes its slot, then a long run of random steps
+    map = room(size, {SHAPE_BLOCK});
+    map.grid[2*size + 2] = pushed;
+    map.grid[6*size + 6] = pushed;
+    map.grid[2*size + 6] = pushed;
+    expect(startMoving(map, 2, 2, 0, 1, 1, 4.0f, false), "startMoving failed on the short push");
+    expect(startMoving(map, 6, 6, -1, 0, 4, 0.9f, true), "startMoving failed on the row platform");
+    expect(startMoving(map, 6, 2, 0, 1, 2, 2.3f, true), "startMoving failed on the column platform");
+    updateMovingBlocks(map, 0.3f);
+    expect(map.grid[3*size + 2] == pushed, "the short push didn't settle");
+    expect(map.moving_blocks.size() == 2 && map.moving_blocks[0].x == 6 && map.moving_blocks[0].dy == 1,
+           "the column platform didn't take the stopped block's slot");
+    expect(consistent(map), "tables disagree after the short push stopped");
+
+    Random random;
+    int bad_steps = 0;
+    int bad_changes = 0;
+    int lost_rays = 0;
+    std::vector<CellEdit> changed;
+    for (int step=0; step<5000; step++) {
+        changed.clear();
+        updateMovingBlocks(map, random()*0.2f, &changed);
+        if (!consistent(map)) bad_steps++;
+        // a cell can be let go of and taken again in one step, the last report is what it holds
+        for (int i=0; i<(int)changed.size(); i++) {
+            const CellEdit& edit = changed[i];
+            bool last = true;
+            for (int j=i+1; j<(int)changed.size(); j++) {
+                if (changed[j].x == edit.x && changed[j].y == edit.y) last = false;
+            }
+            if (edit.value == edit.old_value || (last && map.grid[edit.y*size + edit.x] != edit.value)) bad_changes++;
+        }
+        // the room is closed, a ray from the middle always hits something
+        float angle = random()*6.2831853f;
+        RayHit hit;
+        if (!castRay(map, glm::vec2(4.5f, 4.5f), glm::vec2(std::cos(angle), std::sin(angle)), hit)) lost_rays++;
+    }
+    expect(bad_steps == 0, "tables disagreed after some random steps");
+    expect(bad_changes == 0, "the cells reported changed don't match the grid");
+    expect(lost_rays == 0, "rays left the closed room during the random steps");
+    expect(map.moving_blocks.size() == 2, "a ping-pong block stopped");
+
+    if (failures > 0) {
+        std::cout << failures << " moving block checks failed\n";
+        return 1;
+    }
+    std::cout << "moving blocks: hits, settling and random steps all as expected\n";
+    return 0;
+}
@@ -0,0 +1,101 @@
+// castRay against every CellShape at all four cell rotations, in a 7x7 room with the
+// shape in the middle cell. Prints each case that fails and exits non-zero if any did.
+#include "test_map.h"
+
+namespace {
+
+const int size = 7;
+const int thin = 2*4;           // material 2, a quarter in from the edge
+const int door = 3*4;           // material 3, half open
+const int diagonal = 4*4;
+const int pillar = 5*4;         // radius a quarter
+
+// the ray from pos along dir has to hit face `side` of cell (cell_x, cell_y) at dist
+void expectShapeHit(const Map& map, const char* what, int rotation, glm::vec2 pos, glm::vec2 dir,
+                    int cell_x, int cell_y, int side, float dist) {
+    expectHit(map, what + std::string(" rotation ") + std::to_string(rotation), pos, dir, cell_y*size + cell_x,
+              side, dist);
+}
+
+}
+
+int main() {
+    Map map = room(size, {SHAPE_THIN, SHAPE_DOOR, SHAPE_DIAGONAL, SHAPE_PILLAR}, {0.25f, 0.5f, 0.0f, 0.25f});
+    // the shape sits in cell (3, 3); rays start in (1, 3) heading east or (3, 1) heading
+    // south, and anything that misses it hits the room's far wall 4.5 away
+    int& centre = map.grid[3*size + 3];
+    glm::vec2 west(1.5f, 3.5f);
+    glm::vec2 north(3.5f, 1.5f);
+    glm::vec2 east_dir(1.0f, 0.0f);
+    glm::vec2 south_dir(0.0f, 1.0f);
+
+    // thin: x = param for rotation 0, y = param for 1, 1 - param for 2 and 3
+    for (int rotation=0; rotation<4; rotation++) {
+        centre = thin + rotation;
+        float offset = rotation < 2 ? 0.25f : 0.75f;
+        if (rotation % 2 == 0) {
+            expectShapeHit(map, "thin", rotation, west, east_dir, 3, 3, 0, 1.5f + offset);
+            expectShapeHit(map, "thin from the east", rotation, glm::vec2(5.5f, 3.5f), -east_dir, 3, 3, 2,
+                           2.5f - offset);
+            // parallel to the wall on the side it doesn't reach, through to the wall beyond
+            float x = rotation == 0 ? 3.1f : 3.9f;
+            expectShapeHit(map, "thin passed by", rotation, glm::vec2(x, 1.5f), south_dir, 3, 6, 3, 4.5f);
+        }
+        else {
+            expectShapeHit(map, "thin", rotation, north, south_dir, 3, 3, 3, 1.5f + offset);
+            expectShapeHit(map, "thin from the south", rotation, glm::vec2(3.5f, 5.5f), -south_dir, 3, 3, 1,
+                           2.5f - offset);
+            float y = rotation == 1 ? 3.1f : 3.9f;
+            expectShapeHit(map, "thin passed by", rotation, glm::vec2(1.5f, y), east_dir, 6, 3, 0, 4.5f);
+        }
+    }
+
+    // door: through the middle, the panel on the high side for rotations 0 and 1 and on
+    // the low side for 2 and 3, the gap on the other
+    for (int rotation=0; rotation<4; rotation++) {
+        centre = door + rotation;
+        float panel = rotation < 2 ? 0.7f : 0.3f;
+        float gap = 1.0f - panel;
+        if (rotation % 2 == 0) {
+            expectShapeHit(map, "door panel", rotation, glm::vec2(1.5f, 3.0f + panel), east_dir, 3, 3, 0, 2.0f);
+            expectShapeHit(map, "door gap", rotation, glm::vec2(1.5f, 3.0f + gap), east_dir, 6, 3, 0, 4.5f);
+        }
+        else {
+            expectShapeHit(map, "door panel", rotation, glm::vec2(3.0f + panel, 1.5f), south_dir, 3, 3, 3, 2.0f);
+            expectShapeHit(map, "door gap", rotation, glm::vec2(3.0f + gap, 1.5f), south_dir, 3, 6, 3, 4.5f);
+        }
+    }
+
+    // diagonal: corner to corner, x = y for rotations 0 and 2 and x + y = 1 for 1 and 3
+    for (int rotation=0; rotation<4; rotation++) {
+        centre = diagonal + rotation;
+        bool anti = rotation % 2 == 1;
+        expectShapeHit(map, "diagonal", rotation, glm::vec2(1.5f, 3.25f), east_dir, 3, 3, anti ? 3 : 0,
+                       anti ? 2.25f : 1.75f);
+        expectShapeHit(map, "diagonal from the north", rotation, glm::vec2(3.75f, 1.5f), south_dir, 3, 3,
+                       anti ? 3 : 2, anti ? 1.75f : 2.25f);
+        // along the line without ever crossing it
+        glm::vec2 along = anti ? glm::vec2(1.0f, -1.0f) : glm::vec2(1.0f, 1.0f);
+        glm::vec2 start = anti ? glm::vec2(2.5f, 4.0f) : glm::vec2(2.5f, 2.0f);
+        if (anti) expectShapeHit(map, "diagonal passed by", rotation, start, along, 5, 0, 1, 3.0f*std::sqrt(2.0f));
+        else expectShapeHit(map, "diagonal passed by", rotation, start, along, 6, 5, 0, 3.5f*std::sqrt(2.0f));
+    }
+
+    // pillar: the same round column whichever way the cell is turned
+    for (int rotation=0; rotation<4; rotation++) {
+        centre = pillar + rotation;
+        expectShapeHit(map, "pillar", rotation, west, east_dir, 3, 3, 0, 1.75f);
+        expectShapeHit(map, "pillar from the north", rotation, north, south_dir, 3, 3, 3, 1.75f);
+        float y = 0.2f;
+        expectShapeHit(map, "pillar grazed", rotation, glm::vec2(1.5f, 3.5f + y), east_dir, 3, 3, 1,
+                       2.0f - std::sqrt(0.25f*0.25f - y*y));
+        expectShapeHit(map, "pillar missed", rotation, glm::vec2(1.5f, 3.9f), east_dir, 6, 3, 0, 4.5f);
+    }
+
+    if (failures > 0) {
+        std::cout << failures << " castRay checks failed\n";
+        return 1;
+    }
+    std::cout << "castRay: all shapes and rotations hit where expected\n";
+    return 0;
+}
@@ -0,0 +1,83 @@
+#ifndef TEST_MAP_H
+#define TEST_MAP_H
+
+// What the tests share: a walled room to cast rays in, the checks that count failures
+// and the benchmarks' random numbers. Each test is a single source file, so the
+// stb_image the map code links against is built here.
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include "../include/map.h"
+#include "../include/raycast.h"
+
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+const int room_wall = 4;        // material 1, a plain block
+const int any_cell = -1;        // for expectHit, whichever cell was hit
+
+inline int failures = 0;
+
+// size x size open cells walled round with room_wall. Material 0 is empty and 1 the
+// wall, shapes and params are for materials 2 on; material n has texture n on every face.
+inline Map room(int size, const std::vector<uint8_t>& shapes={}, const std::vector<float>& params={}) {
+    Map map;
+    map.width = size;
+    map.height = size;
+    map.manifest.wall_height = 4.0f;
+    map.wall_top = 4.0f;
+    map.grid.assign(size*size, 0);
+    for (int i=0; i<size; i++) {
+        map.grid[i] = map.grid[(size-1)*size + i] = room_wall;
+        map.grid[i*size] = map.grid[i*size + size-1] = room_wall;
+    }
+    int count = 2 + shapes.size();
+    std::vector<int> tex_sides;
+    for (int material=0; material<count; material++) tex_sides.insert(tex_sides.end(), 4, material);
+    std::vector<uint8_t> all_shapes = {SHAPE_BLOCK, SHAPE_BLOCK};
+    all_shapes.insert(all_shapes.end(), shapes.begin(), shapes.end());
+    std::vector<float> all_params = {0.0f, 0.0f};
+    all_params.insert(all_params.end(), params.begin(), params.end());
+    all_params.resize(count, 0.0f);
+    buildMaterialTable(tex_sides, std::vector<uint8_t>(count, 0), std::vector<float>(count, 1.0f), all_shapes,
+                       all_params, count*4, map.materials);
+    return map;
+}
+
+inline void expect(bool ok, const std::string& what) {
+    if (ok) return;
+    failures++;
+    std::cout << what << "\n";
+}
+
+// the ray from pos along dir has to hit face `side` of cell (an index into map.grid,
+// or any_cell) at dist
+inline void expectHit(const Map& map, const std::string& what, glm::vec2 pos, glm::vec2 dir, int cell, int side,
+                      float dist) {
+    RayHit hit;
+    bool found = castRay(map, pos, glm::normalize(dir), hit);
+    bool right_cell = cell == any_cell || hit.cell == cell;
+    if (found && right_cell && hit.side == side && std::abs(hit.dist - dist) < 1e-4f) return;
+    failures++;
+    std::cout << what << ": ";
+    if (!found) std::cout << "no hit";
+    else std::cout << "cell " << hit.cell << " side " << hit.side << " at " << hit.dist;
+    std::cout << ", expected";
+    if (cell != any_cell) std::cout << " cell " << cell;
+    std::cout << " side " << side << " at " << dist << "\n";
+}
+
+// 0-1, the same sequence every run
+struct Random {
+    uint32_t seed = 12345;
+
+    float operator()() {
+        seed = seed*1664525u + 1013904223u;
+        return (seed >> 8) / 16777216.0f;
+    }
+};
+
+#endif